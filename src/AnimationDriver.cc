@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2020 Chris Holland <zrenfire@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// own
+#include "AnimationDriver.h"
+
+// Qt
+#include <QEasingCurve>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QRegion>
+#include <QTimer>
+#include <QVector>
+
+
+namespace Material
+{
+
+class AnimationDriver
+{
+public:
+    AnimationDriver();
+    ~AnimationDriver();
+
+    void start(Transition *transition);
+    void stop(Transition *transition);
+
+private:
+    void tick();
+
+    QTimer *m_timer;
+    QElapsedTimer m_clock;
+    QVector<Transition *> m_running;
+};
+
+// The driver lives as long as there is at least one Transition, so it does
+// not outlive the plugin when KWin unloads the decoration.
+static int s_transitionCount = 0;
+static AnimationDriver *s_driver = nullptr;
+
+// ~60 frames per second
+static const int s_frameInterval = 16;
+
+// Shared by all transitions rather than a copy in each one.
+static const QEasingCurve s_easingCurve(QEasingCurve::InOutQuad);
+
+AnimationDriver::AnimationDriver()
+    : m_timer(new QTimer())
+{
+    m_timer->setInterval(s_frameInterval);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    QObject::connect(m_timer, &QTimer::timeout, m_timer, [this] {
+        tick();
+    });
+}
+
+AnimationDriver::~AnimationDriver()
+{
+    delete m_timer;
+}
+
+void AnimationDriver::start(Transition *transition)
+{
+    if (m_running.contains(transition)) {
+        return;
+    }
+    m_running.append(transition);
+
+    if (!m_timer->isActive()) {
+        m_clock.start();
+        m_timer->start();
+    }
+}
+
+void AnimationDriver::stop(Transition *transition)
+{
+    m_running.removeOne(transition);
+
+    if (m_running.isEmpty()) {
+        m_timer->stop();
+    }
+}
+
+void AnimationDriver::tick()
+{
+    const int elapsed = static_cast<int>(m_clock.restart());
+
+    // Callbacks may start or stop other transitions, so walk a copy.
+    const QVector<Transition *> running = m_running;
+    // Only the animated parts are damaged, not the span between them.
+    QHash<KDecoration2::Decoration *, QRegion> damage;
+
+    for (Transition *transition : running) {
+        if (!m_running.contains(transition)) {
+            continue;
+        }
+
+        transition->advance(elapsed);
+        const QRect rect = transition->m_callback(transition->value());
+        if (!rect.isEmpty()) {
+            damage[transition->m_decoration] += rect;
+        }
+
+        if (!transition->m_running) {
+            m_running.removeOne(transition);
+        }
+    }
+
+    for (auto it = damage.constBegin(); it != damage.constEnd(); ++it) {
+        for (const QRect &rect : it.value()) {
+            it.key()->update(rect);
+        }
+    }
+
+    if (m_running.isEmpty()) {
+        m_timer->stop();
+    }
+}
+
+
+Transition::Transition(KDecoration2::Decoration *decoration, const Callback &callback)
+    : m_decoration(decoration)
+    , m_callback(callback)
+    , m_duration(0)
+    , m_progress(0)
+    , m_direction(QAbstractAnimation::Forward)
+    , m_running(false)
+{
+    if (s_transitionCount++ == 0) {
+        s_driver = new AnimationDriver();
+    }
+}
+
+Transition::~Transition()
+{
+    s_driver->stop(this);
+
+    if (--s_transitionCount == 0) {
+        delete s_driver;
+        s_driver = nullptr;
+    }
+}
+
+int Transition::duration() const
+{
+    return m_duration;
+}
+
+void Transition::setDuration(int duration)
+{
+    m_duration = duration;
+}
+
+QAbstractAnimation::Direction Transition::direction() const
+{
+    return m_direction;
+}
+
+bool Transition::isRunning() const
+{
+    return m_running;
+}
+
+void Transition::start(QAbstractAnimation::Direction direction)
+{
+    m_direction = direction;
+
+    // Reversing a running transition continues from its current value.
+    const qreal target = direction == QAbstractAnimation::Forward ? 1 : 0;
+    if (m_progress == target) {
+        stop();
+        return;
+    }
+
+    if (m_duration <= 0) {
+        m_running = true;
+        finish();
+        return;
+    }
+
+    m_running = true;
+    s_driver->start(this);
+}
+
+void Transition::stop()
+{
+    m_running = false;
+    s_driver->stop(this);
+}
+
+void Transition::finish()
+{
+    if (!m_running) {
+        return;
+    }
+    stop();
+    m_progress = m_direction == QAbstractAnimation::Forward ? 1 : 0;
+    const QRect rect = m_callback(value());
+    if (!rect.isEmpty()) {
+        m_decoration->update(rect);
+    }
+}
+
+qreal Transition::value() const
+{
+    return s_easingCurve.valueForProgress(m_progress);
+}
+
+void Transition::advance(int elapsed)
+{
+    const qreal step = m_duration > 0 ? static_cast<qreal>(elapsed) / m_duration : 1;
+
+    if (m_direction == QAbstractAnimation::Forward) {
+        m_progress = qMin<qreal>(1, m_progress + step);
+        m_running = m_progress < 1;
+    } else {
+        m_progress = qMax<qreal>(0, m_progress - step);
+        m_running = m_progress > 0;
+    }
+}
+
+} // namespace Material
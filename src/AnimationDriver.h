@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2020 Chris Holland <zrenfire@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// KDecoration
+#include <KDecoration2/Decoration>
+
+// Qt
+#include <QAbstractAnimation>
+#include <QRect>
+
+// std
+#include <functional>
+
+namespace Material
+{
+
+// A 0 to 1 transition, eg: the hover state of a button.
+//
+// Rather than each owning a QVariantAnimation, all transitions in the process
+// are ticked once per frame by a single AnimationDriver, which only walks the
+// running transitions. The callback applies the eased value and returns the
+// area of the decoration to repaint. The driver merges those areas into one
+// update() per decoration per frame.
+class Transition
+{
+public:
+    using Callback = std::function<QRect(qreal value)>;
+
+    Transition(KDecoration2::Decoration *decoration, const Callback &callback);
+    ~Transition();
+
+    int duration() const;
+    void setDuration(int duration);
+
+    QAbstractAnimation::Direction direction() const;
+    bool isRunning() const;
+
+    void start(QAbstractAnimation::Direction direction);
+    void stop();
+    // Stops a running transition at the value it was heading to.
+    void finish();
+
+private:
+    friend class AnimationDriver;
+
+    qreal value() const;
+    void advance(int elapsed);
+
+    KDecoration2::Decoration *m_decoration;
+    Callback m_callback;
+    int m_duration;
+    qreal m_progress;
+    QAbstractAnimation::Direction m_direction;
+    bool m_running;
+
+    Q_DISABLE_COPY(Transition)
+};
+
+} // namespace Material
@@ -29,8 +29,11 @@
 #include <KIconLoader>
 
 // Qt
+#include <QCache>
+#include <QIcon>
 #include <QPainter>
 #include <QPalette>
+#include <QPixmap>
 
 namespace Material
 {
@@ -40,8 +43,28 @@ class AppIconButton
 
 public:
     static void init(Button *button, KDecoration2::DecoratedClient *decoratedClient) {
+        QString cacheId = iconCacheId(decoratedClient->icon());
         QObject::connect(decoratedClient, &KDecoration2::DecoratedClient::iconChanged,
+            button, [button, decoratedClient, cacheId]() mutable {
+                // Drop the pixmaps of the previous icon. It may also have
+                // kept its name but changed its contents.
+                const QString prefix = cacheId + QLatin1Char('|');
+                auto &cache = pixmapCache();
+                const auto keys = cache.keys();
+                for (const QString &key : keys) {
+                    if (key.startsWith(prefix)) {
+                        cache.remove(key);
+                    }
+                }
+                cacheId = iconCacheId(decoratedClient->icon());
+                button->update();
+            }
+        );
+
+        // Named icons are cached by name, so a theme switch invalidates them.
+        QObject::connect(KIconLoader::global(), &KIconLoader::iconLoaderSettingsChanged,
             button, [button] {
+                pixmapCache().clear();
                 button->update();
             }
         );
@@ -56,17 +79,67 @@ public:
 
         const auto *deco = qobject_cast<Decoration *>(button->decoration());
         auto *decoratedClient = deco->client().toStrongRef().data();
+        const QIcon icon = decoratedClient->icon();
+        const QColor foreground = deco->titleBarForegroundColor();
+        const qreal dpr = painter->device() ? painter->device()->devicePixelRatioF() : 1;
+
+        // Windows of the same application share their icon name, so they
+        // share the rendered pixmap too.
+        const QString key = QStringLiteral("%1|%2|%3|%4")
+            .arg(iconCacheId(icon))
+            .arg(appIconSize)
+            .arg(dpr)
+            .arg(foreground.rgba());
 
+        auto &cache = pixmapCache();
+        if (const QPixmap *cached = cache.object(key)) {
+            painter->drawPixmap(appIconRect.toRect().topLeft(), *cached);
+            return;
+        }
+
+        QPixmap pixmap(QSize(appIconSize, appIconSize) * dpr);
+        pixmap.setDevicePixelRatio(dpr);
+        pixmap.fill(Qt::transparent);
+
+        // Symbolic SVG icons are recoloured with KIconLoader's palette.
         const QPalette activePalette = KIconLoader::global()->customPalette();
         QPalette palette = decoratedClient->palette();
-        palette.setColor(QPalette::WindowText, deco->titleBarForegroundColor());
+        palette.setColor(QPalette::WindowText, foreground);
         KIconLoader::global()->setCustomPalette(palette);
-        decoratedClient->icon().paint(painter, appIconRect.toRect());
+
+        QPainter pixmapPainter(&pixmap);
+        icon.paint(&pixmapPainter, QRect(0, 0, appIconSize, appIconSize));
+        pixmapPainter.end();
+
         if (activePalette == QPalette()) {
             KIconLoader::global()->resetPalette();
         } else {
-            KIconLoader::global()->setCustomPalette(palette);
+            KIconLoader::global()->setCustomPalette(activePalette);
         }
+
+        painter->drawPixmap(appIconRect.toRect().topLeft(), pixmap);
+
+        // Cost in KiB
+        const int cost = qMax(1, pixmap.width() * pixmap.height() * 4 / 1024);
+        cache.insert(key, new QPixmap(pixmap), cost);
+    }
+
+    // Called when the last decoration is destroyed.
+    static void clearCache() {
+        pixmapCache().clear();
+    }
+
+private:
+    static QString iconCacheId(const QIcon &icon) {
+        return icon.name().isEmpty()
+            ? QString::number(icon.cacheKey())
+            : icon.name();
+    }
+
+    static QCache<QString, QPixmap> &pixmapCache() {
+        // 1 MiB, enough for a few dozen applications at 2x scale.
+        static QCache<QString, QPixmap> cache(1024);
+        return cache;
     }
 };
 
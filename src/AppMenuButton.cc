@@ -27,9 +27,6 @@
 // KDecoration
 #include <KDecoration2/DecoratedClient>
 
-// KF
-#include <KColorUtils>
-
 // Qt
 #include <QDebug>
 
@@ -61,6 +58,14 @@ int AppMenuButton::buttonIndex() const
     return m_buttonIndex;
 }
 
+void AppMenuButton::setButtonIndex(int value)
+{
+    if (m_buttonIndex != value) {
+        m_buttonIndex = value;
+        emit buttonIndexChanged();
+    }
+}
+
 QColor AppMenuButton::backgroundColor() const
 {
     const auto *buttonGroup = qobject_cast<AppMenuButtonGroup *>(parent());
@@ -85,10 +90,8 @@ QColor AppMenuButton::foregroundColor() const
         if (!deco) {
             return {};
         }
-        return KColorUtils::mix(
-            deco->titleBarBackgroundColor(),
-            deco->titleBarForegroundColor(),
-            0.8);
+        const QRgb normalColor = deco->buttonColors(Decoration::NormalButtonColors).foreground.normal;
+        return QColor::fromRgba(qUnpremultiply(normalColor));
     } else {
         return Button::foregroundColor();
     }
@@ -36,6 +36,7 @@ public:
     Q_PROPERTY(int buttonIndex READ buttonIndex NOTIFY buttonIndexChanged)
 
     int buttonIndex() const;
+    void setButtonIndex(int value);
 
     QColor backgroundColor() const override;
     QColor foregroundColor() const override;
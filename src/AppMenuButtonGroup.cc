@@ -38,9 +38,9 @@
 // Qt
 #include <QAction>
 #include <QDebug>
+#include <QHash>
 #include <QMenu>
 #include <QPainter>
-#include <QVariantAnimation>
 
 
 namespace Material
@@ -55,7 +55,12 @@ AppMenuButtonGroup::AppMenuButtonGroup(Decoration *decoration)
     , m_showing(true)
     , m_alwaysShow(true)
     , m_animationEnabled(false)
-    , m_animation(new QVariantAnimation(this))
+    , m_transition(decoration, [this](qreal value) {
+        // Decoration repaints the titlebar on opacityChanged, which
+        // also covers the caption fading in and out.
+        setOpacity(value);
+        return QRect();
+    })
     , m_opacity(1)
 {
     // Assign showing and opacity before we bind the onShowingChanged animation
@@ -74,18 +79,29 @@ AppMenuButtonGroup::AppMenuButtonGroup(Decoration *decoration)
             this, &AppMenuButtonGroup::updateShowing);
 
     m_animationEnabled = decoration->animationsEnabled();
-    m_animation->setDuration(decoration->animationsDuration());
-    m_animation->setStartValue(0.0);
-    m_animation->setEndValue(1.0);
-    m_animation->setEasingCurve(QEasingCurve::InOutQuad);
-    connect(m_animation, &QVariantAnimation::valueChanged, this, [this](const QVariant &value) {
-        setOpacity(value.toReal());
-    });
+    m_transition.setDuration(decoration->animationsDuration());
     connect(this, &AppMenuButtonGroup::opacityChanged, this, [this]() {
         // update();
     });
 
+    setMenuPrefetch(decoration->menuPrefetch());
+
+    // Load the submenus before they are likely to be opened, ie: when the
+    // titlebar is hovered or the window gets keyboard focus.
     auto *decoratedClient = decoration->client().toStrongRef().data();
+    connect(this, &AppMenuButtonGroup::hoveredChanged,
+            this, [this](bool hovered) {
+                if (hovered && m_appMenuModel) {
+                    m_appMenuModel->prefetchMenus();
+                }
+            });
+    connect(decoratedClient, &KDecoration2::DecoratedClient::activeChanged,
+            this, [this](bool active) {
+                if (active && m_appMenuModel) {
+                    m_appMenuModel->prefetchMenus();
+                }
+            });
+
     connect(decoratedClient, &KDecoration2::DecoratedClient::hasApplicationMenuChanged,
             this, &AppMenuButtonGroup::updateAppMenuModel);
     connect(this, &AppMenuButtonGroup::requestActivateIndex,
@@ -168,6 +184,21 @@ void AppMenuButtonGroup::setAlwaysShow(bool value)
     }
 }
 
+int AppMenuButtonGroup::menuPrefetch() const
+{
+    return m_menuPrefetch;
+}
+
+void AppMenuButtonGroup::setMenuPrefetch(int value)
+{
+    if (m_menuPrefetch != value) {
+        m_menuPrefetch = value;
+        if (m_appMenuModel) {
+            m_appMenuModel->setPrefetchPolicy(value);
+        }
+    }
+}
+
 bool AppMenuButtonGroup::animationEnabled() const
 {
     return m_animationEnabled;
@@ -177,19 +208,23 @@ void AppMenuButtonGroup::setAnimationEnabled(bool value)
 {
     if (m_animationEnabled != value) {
         m_animationEnabled = value;
+        if (!value) {
+            // See Button::setAnimationEnabled()
+            m_transition.finish();
+        }
         emit animationEnabledChanged(value);
     }
 }
 
 int AppMenuButtonGroup::animationDuration() const
 {
-    return m_animation->duration();
+    return m_transition.duration();
 }
 
 void AppMenuButtonGroup::setAnimationDuration(int value)
 {
-    if (m_animation->duration() != value) {
-        m_animation->setDuration(value);
+    if (m_transition.duration() != value) {
+        m_transition.setDuration(value);
         emit animationDurationChanged(value);
     }
 }
@@ -250,13 +285,35 @@ void AppMenuButtonGroup::resetButtons()
 void AppMenuButtonGroup::initAppMenuModel()
 {
     m_appMenuModel = new AppMenuModel(this);
+    m_appMenuModel->setPrefetchPolicy(m_menuPrefetch);
     connect(m_appMenuModel, &AppMenuModel::modelReset,
         this, &AppMenuButtonGroup::updateAppMenuModel);
+
+    // A layout update may emit several row signals in a row, so
+    // diff the buttons once they are all done.
+    connect(m_appMenuModel, &AppMenuModel::rowsInserted,
+        this, &AppMenuButtonGroup::scheduleAppMenuUpdate);
+    connect(m_appMenuModel, &AppMenuModel::rowsRemoved,
+        this, &AppMenuButtonGroup::scheduleAppMenuUpdate);
+    connect(m_appMenuModel, &AppMenuModel::rowsMoved,
+        this, &AppMenuButtonGroup::scheduleAppMenuUpdate);
+    connect(m_appMenuModel, &AppMenuModel::dataChanged,
+        this, &AppMenuButtonGroup::scheduleAppMenuUpdate);
     // qCDebug(category) << "AppMenuModel" << m_appMenuModel;
 }
 
+void AppMenuButtonGroup::scheduleAppMenuUpdate()
+{
+    if (!m_appMenuUpdatePending) {
+        m_appMenuUpdatePending = true;
+        QMetaObject::invokeMethod(this, "updateAppMenuModel", Qt::QueuedConnection);
+    }
+}
+
 void AppMenuButtonGroup::updateAppMenuModel()
 {
+    m_appMenuUpdatePending = false;
+
     auto *deco = qobject_cast<Decoration *>(decoration());
     if (!deco) {
         return;
@@ -278,7 +335,21 @@ void AppMenuButtonGroup::updateAppMenuModel()
         // Update AppMenuModel
         // qCDebug(category) << "AppMenuModel" << m_appMenuModel;
 
-        resetButtons();
+        // Diff against the existing buttons, keyed by QAction, so that only
+        // new menus get a button and only changed labels are measured again.
+        QHash<QAction *, TextButton *> previousButtons;
+        MenuOverflowButton *overflowButton = nullptr;
+        for (KDecoration2::DecorationButton *button : buttons()) {
+            if (auto *textButton = qobject_cast<TextButton *>(button)) {
+                previousButtons.insert(textButton->action(), textButton);
+            } else if (auto *menuOverflowButton = qobject_cast<MenuOverflowButton *>(button)) {
+                overflowButton = menuOverflowButton;
+            }
+        }
+
+        bool changed = false;
+        QVector<KDecoration2::DecorationButton *> orderedButtons;
+        orderedButtons.reserve(m_appMenuModel->rowCount() + 1);
 
         // Populate
         for (int row = 0; row < m_appMenuModel->rowCount(); row++) {
@@ -291,23 +362,64 @@ void AppMenuButtonGroup::updateAppMenuModel()
 
             // qCDebug(category) << "    " << itemAction;
 
-            TextButton *b = new TextButton(deco, row, this);
+            TextButton *b = previousButtons.take(itemAction);
+            if (b) {
+                changed |= b->buttonIndex() != row || b->text() != itemLabel;
+                b->setButtonIndex(row);
+            } else {
+                b = new TextButton(deco, row, this);
+                b->setAction(itemAction);
+                b->setOpacity(m_opacity);
+                changed = true;
+            }
             b->setText(itemLabel);
-            b->setAction(itemAction);
-            b->setOpacity(m_opacity);
 
             // Skip items with empty labels (The first item in a Gtk app)
             if (itemLabel.isEmpty()) {
                 b->setEnabled(false);
                 b->setVisible(false);
+            } else if (!b->isEnabled()) {
+                b->setEnabled(true);
+                b->setVisible(true);
             }
-            
-            addButton(QPointer<KDecoration2::DecorationButton>(b));
+
+            orderedButtons.append(b);
         }
+
         m_overflowIndex = m_appMenuModel->rowCount();
-        addButton(new MenuOverflowButton(deco, m_overflowIndex, this));
+        if (overflowButton) {
+            overflowButton->setButtonIndex(m_overflowIndex);
+        } else {
+            overflowButton = new MenuOverflowButton(deco, m_overflowIndex, this);
+            changed = true;
+        }
+        orderedButtons.append(overflowButton);
+
+        // Buttons for menus that are gone.
+        if (!previousButtons.isEmpty()) {
+            changed = true;
+            for (TextButton *b : qAsConst(previousButtons)) {
+                removeButton(QPointer<KDecoration2::DecorationButton>(b));
+                delete b;
+            }
+        }
 
-        emit menuUpdated();
+        // Only rebuild the button list when the order changed.
+        const auto currentButtons = buttons();
+        bool reorder = currentButtons.size() != orderedButtons.size();
+        for (int i = 0; !reorder && i < orderedButtons.size(); i++) {
+            reorder = currentButtons.at(i) != orderedButtons.at(i);
+        }
+        if (reorder) {
+            removeButton(KDecoration2::DecorationButtonType::Custom);
+            for (KDecoration2::DecorationButton *b : qAsConst(orderedButtons)) {
+                addButton(QPointer<KDecoration2::DecorationButton>(b));
+            }
+        }
+
+        if (changed) {
+            emit menuUpdated();
+        }
 
     } else {
         // Init AppMenuModel
@@ -558,14 +670,7 @@ void AppMenuButtonGroup::onMenuAboutToHide()
 void AppMenuButtonGroup::onShowingChanged(bool showing)
 {
     if (m_animationEnabled) {
-        QAbstractAnimation::Direction dir = showing ? QAbstractAnimation::Forward : QAbstractAnimation::Backward;
-        if (m_animation->state() == QAbstractAnimation::Running && m_animation->direction() != dir) {
-            m_animation->stop();
-        }
-        m_animation->setDirection(dir);
-        if (m_animation->state() != QAbstractAnimation::Running) {
-            m_animation->start();
-        }
+        m_transition.start(showing ? QAbstractAnimation::Forward : QAbstractAnimation::Backward);
     } else {
         setOpacity(showing ? 1 : 0);
     }
@@ -18,6 +18,7 @@
 #pragma once
 
 // own
+#include "AnimationDriver.h"
 #include "AppMenuModel.h"
 
 // KDecoration
@@ -27,7 +28,6 @@
 
 // Qt
 #include <QMenu>
-#include <QVariantAnimation>
 
 namespace Material
 {
@@ -66,6 +66,10 @@ public:
     bool alwaysShow() const;
     void setAlwaysShow(bool value);
 
+    // InternalSettings::EnumMenuPrefetch
+    int menuPrefetch() const;
+    void setMenuPrefetch(int value);
+
     bool animationEnabled() const;
     void setAnimationEnabled(bool value);
 
@@ -84,6 +88,7 @@ public:
 public slots:
     void initAppMenuModel();
     void updateAppMenuModel();
+    void scheduleAppMenuUpdate();
     void updateOverflow(QRectF availableRect);
     void trigger(int index);
     void triggerOverflow();
@@ -121,9 +126,11 @@ private:
     bool m_showing;
     bool m_alwaysShow;
     bool m_animationEnabled;
-    QVariantAnimation *m_animation;
+    Transition m_transition;
     qreal m_opacity;
     QPointer<QMenu> m_currentMenu;
+    bool m_appMenuUpdatePending = false;
+    int m_menuPrefetch = 0;
 };
 
 } // namespace Material
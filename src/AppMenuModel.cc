@@ -28,8 +28,11 @@
 #include "AppMenuModel.h"
 #include "Material.h"
 #include "BuildConfig.h"
+#include "InternalSettings.h"
+#include "ThemedIconCache.h"
 
 // KF
+#include <KWindowInfo>
 #include <KWindowSystem>
 // In KF5 5.101, KWindowSystem moved several signals to KX11Extras
 // Eg: https://invent.kde.org/frameworks/kwindowsystem/-/commit/7cfd7c36eb017242d7a0202db82895be6b8fb81c
@@ -41,6 +44,7 @@
 #include <QAction>
 #include <QDebug>
 #include <QMenu>
+#include <QSet>
 #include <QDBusConnection>
 #include <QDBusConnectionInterface>
 #include <QDBusServiceWatcher>
@@ -69,25 +73,51 @@ static const QByteArray s_x11AppMenuObjectPathPropertyName = QByteArrayLiteral("
 static QHash<QByteArray, xcb_atom_t> s_atoms;
 #endif
 
+// Applications that only build their submenus when they are about to be
+// shown, matched against the start of the window class. Importing their
+// full tree would only return empty submenus.
+//
+// LibreOffice fills its exported submenus from its own menu activation
+// handler, and Firefox and Thunderbird export through the
+// appmenu-gtk-module / unity-menubar bridges, which fill them from the
+// popupshowing event. Before adding a class, check that
+//     qdbus <service> /MenuBar com.canonical.dbusmenu.GetLayout 0 -1 []
+// returns submenus without children for it.
+static const QStringList s_lazyMenuWindowClasses = {
+    QStringLiteral("libreoffice"),
+    QStringLiteral("soffice"),
+    QStringLiteral("firefox"),
+    QStringLiteral("thunderbird"),
+};
+
+// Submenus populated at the same time. Every prefetch makes the application
+// rebuild a menu, so don't ask for all of them at once.
+static const int s_maxPrefetches = 2;
+
 class KDBusMenuImporter : public DBusMenuImporter
 {
 
 public:
-    KDBusMenuImporter(const QString &service, const QString &path, QObject *parent)
-        : DBusMenuImporter(service, path, parent) {
+    KDBusMenuImporter(const QString &service, const QString &path, ImportMode mode, QObject *parent)
+        : DBusMenuImporter(service, path, mode, parent) {
 
     }
 
 protected:
     QIcon iconForName(const QString &name) override {
-        return QIcon::fromTheme(name);
+        return ThemedIconCache::self()->icon(name);
+    }
+
+    void prepareIcons(const QStringList &names) override {
+        ThemedIconCache::self()->prepare(names);
     }
 
 };
 
 AppMenuModel::AppMenuModel(QObject *parent)
     : QAbstractListModel(parent),
-      m_serviceWatcher(new QDBusServiceWatcher(this))
+      m_serviceWatcher(new QDBusServiceWatcher(this)),
+      m_prefetchPolicy(InternalSettings::PrefetchOnHover)
 {
     if (KWindowSystem::isPlatformX11()) {
 #if HAVE_X11
@@ -197,23 +227,199 @@ void AppMenuModel::setWinId(const QVariant &id)
     emit winIdChanged();
 }
 
-int AppMenuModel::rowCount(const QModelIndex &parent) const
+int AppMenuModel::prefetchPolicy() const
 {
-    Q_UNUSED(parent);
+    return m_prefetchPolicy;
+}
+
+void AppMenuModel::setPrefetchPolicy(int policy)
+{
+    if (m_prefetchPolicy == policy) {
+        return;
+    }
+    m_prefetchPolicy = policy;
+
+    if (m_prefetchPolicy == InternalSettings::PrefetchEager) {
+        prefetchMenus();
+    }
+}
+
+void AppMenuModel::prefetchMenus()
+{
+    if (m_prefetchPolicy == InternalSettings::PrefetchOnOpen || !m_importer) {
+        return;
+    }
+
+    for (QAction *a : qAsConst(m_actions)) {
+        QMenu *menu = a->menu();
+        if (!menu
+            || m_prefetching.contains(menu)
+            || m_prefetchQueue.contains(menu)
+            || m_prefetchedRevision.value(menu) == m_revision
+        ) {
+            continue;
+        }
+        m_prefetchQueue.append(menu);
+    }
+
+    prefetchNext();
+}
+
+void AppMenuModel::prefetchNext()
+{
+    while (m_prefetching.count() < s_maxPrefetches && !m_prefetchQueue.isEmpty()) {
+        QPointer<QMenu> menu = m_prefetchQueue.takeFirst();
+        if (!menu || !m_importer) {
+            continue;
+        }
 
-    if (!m_menuAvailable || !m_menu) {
-        return 0;
+        if (!m_prefetchedRevision.contains(menu)) {
+            QMenu *submenu = menu.data();
+            connect(submenu, &QObject::destroyed, this, [this, submenu] {
+                m_prefetchedRevision.remove(submenu);
+                if (m_prefetching.remove(submenu)) {
+                    prefetchNext();
+                }
+            });
+        }
+        m_prefetchedRevision.insert(menu, m_revision);
+        m_prefetching.insert(menu);
+
+        // The importer emits menuUpdated(menu) when done, even on errors.
+        m_importer->updateMenu(menu);
     }
+}
+
+void AppMenuModel::resetPrefetch()
+{
+    for (auto it = m_prefetchedRevision.constBegin(); it != m_prefetchedRevision.constEnd(); ++it) {
+        disconnect(it.key(), &QObject::destroyed, this, nullptr);
+    }
+    m_prefetchedRevision.clear();
+    m_prefetchQueue.clear();
+    m_prefetching.clear();
+}
+
+int AppMenuModel::rowCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
 
-    return m_menu->actions().count();
+    return m_actions.count();
 }
 
 void AppMenuModel::update()
 {
     // qCDebug(category) << "AppMenuModel::update (" << m_winId << ")";
-    beginResetModel();
-    endResetModel();
     m_updatePending = false;
+
+    QMenu *menu = m_menuAvailable ? m_menu.data() : nullptr;
+    const QList<QAction *> actions = menu ? menu->actions() : QList<QAction *>();
+
+    if (menu != m_actionsMenu) {
+        // A different menu, nothing to diff against.
+        beginResetModel();
+        for (QAction *a : qAsConst(m_actions)) {
+            disconnect(a, nullptr, this, nullptr);
+        }
+        m_actions.clear();
+        m_rows.clear();
+        for (QAction *a : actions) {
+            m_rows.insert(a, m_actions.count());
+            m_actions.append(a);
+            watchAction(a);
+        }
+        m_actionsMenu = menu;
+        endResetModel();
+        return;
+    }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    const QSet<QAction *> actionSet(actions.begin(), actions.end());
+#else
+    const QSet<QAction *> actionSet = actions.toSet();
+#endif
+
+    // Rows for actions that are no longer in the menu, last to first so
+    // that contiguous actions are removed together.
+    int row = m_actions.count() - 1;
+    while (row >= 0) {
+        if (actionSet.contains(m_actions.at(row))) {
+            row--;
+            continue;
+        }
+        int first = row;
+        while (first > 0 && !actionSet.contains(m_actions.at(first - 1))) {
+            first--;
+        }
+        beginRemoveRows(QModelIndex(), first, row);
+        for (int i = first; i <= row; i++) {
+            disconnect(m_actions.at(i), nullptr, this, nullptr);
+            m_rows.remove(m_actions.at(i));
+        }
+        m_actions.remove(first, row - first + 1);
+        updateRows(first, m_actions.count() - 1);
+        endRemoveRows();
+        row = first - 1;
+    }
+
+    // Move or insert the rest into place.
+    for (int i = 0; i < actions.count(); i++) {
+        QAction *a = actions.at(i);
+        if (i < m_actions.count() && m_actions.at(i) == a) {
+            continue;
+        }
+
+        const int from = m_rows.value(a, -1);
+        if (from >= 0) {
+            beginMoveRows(QModelIndex(), from, from, QModelIndex(), i);
+            m_actions.move(from, i);
+            updateRows(i, from);
+            endMoveRows();
+        } else {
+            beginInsertRows(QModelIndex(), i, i);
+            m_actions.insert(i, a);
+            updateRows(i, m_actions.count() - 1);
+            watchAction(a);
+            endInsertRows();
+        }
+    }
+}
+
+void AppMenuModel::updateRows(int first, int last)
+{
+    for (int row = first; row <= last; row++) {
+        m_rows.insert(m_actions.at(row), row);
+    }
+}
+
+int AppMenuModel::rowForAction(QAction *a) const
+{
+    return m_rows.value(a, -1);
+}
+
+void AppMenuModel::watchAction(QAction *a)
+{
+    // signal dataChanged when the action changes
+    connect(a, &QAction::changed, this, [this, a] {
+        const int row = rowForAction(a);
+        if (row > -1) {
+            const QModelIndex modelIdx = index(row, 0);
+            emit dataChanged(modelIdx, modelIdx);
+        }
+    });
+
+    // Drop the row right away rather than waiting for the next layout
+    // update, so that we never hand out a dangling QAction.
+    connect(a, &QAction::destroyed, this, [this, a] {
+        const int row = rowForAction(a);
+        if (row > -1) {
+            beginRemoveRows(QModelIndex(), row, row);
+            m_rows.remove(a);
+            m_actions.remove(row);
+            updateRows(row, m_actions.count() - 1);
+            endRemoveRows();
+        }
+    });
 }
 
 
@@ -335,25 +541,39 @@ QVariant AppMenuModel::data(const QModelIndex &index, int role) const
 {
     const int row = index.row();
 
-    if (row < 0 || !m_menuAvailable || !m_menu) {
+    if (row < 0) {
         return QVariant();
     }
 
-    const auto actions = m_menu->actions();
-
-    if (row >= actions.count()) {
+    if (row >= m_actions.count()) {
         return QVariant();
     }
 
     if (role == MenuRole) { // TODO this should be Qt::DisplayRole
-        return actions.at(row)->text();
+        return m_actions.at(row)->text();
     } else if (role == ActionRole) {
-        return QVariant::fromValue((void *) actions.at(row));
+        return QVariant::fromValue((void *) m_actions.at(row));
     }
 
     return QVariant();
 }
 
+DBusMenuImporter::ImportMode AppMenuModel::importMode() const
+{
+#if HAVE_X11
+    if (KWindowSystem::isPlatformX11()) {
+        const KWindowInfo info(m_winId.toUInt(), NET::Properties(), NET::WM2WindowClass);
+        const QString windowClass = QString::fromLatin1(info.windowClassClass()).toLower();
+        for (const QString &lazyClass : s_lazyMenuWindowClasses) {
+            if (windowClass.startsWith(lazyClass)) {
+                return DBusMenuImporter::ImportOneLevel;
+            }
+        }
+    }
+#endif
+    return DBusMenuImporter::ImportFullTree;
+}
+
 void AppMenuModel::updateApplicationMenu(const QString &serviceName, const QString &menuObjectPath)
 {
     if (m_serviceName == serviceName && m_menuObjectPath == menuObjectPath) {
@@ -371,51 +591,49 @@ void AppMenuModel::updateApplicationMenu(const QString &serviceName, const QStri
     if (m_importer) {
         m_importer->deleteLater();
     }
+    resetPrefetch();
 
-    m_importer = new KDBusMenuImporter(serviceName, menuObjectPath, this);
+    m_importer = new KDBusMenuImporter(serviceName, menuObjectPath, importMode(), this);
     QMetaObject::invokeMethod(m_importer, "updateMenu", Qt::QueuedConnection);
 
     connect(m_importer.data(), &DBusMenuImporter::menuUpdated, this, [=](QMenu *menu) {
-        m_menu = m_importer->menu();
-        if (m_menu.isNull() || menu != m_menu) {
+        if (m_prefetching.remove(menu)) {
+            prefetchNext();
             return;
         }
 
-        // cache first layer of sub menus, which we'll be popping up
-        const auto actions = m_menu->actions();
-        for (QAction *a : actions) {
-            // signal dataChanged when the action changes
-            connect(a, &QAction::changed, this, [this, a] {
-                if (m_menuAvailable && m_menu) {
-                    const int actionIdx = m_menu->actions().indexOf(a);
-                    if (actionIdx > -1) {
-                        const QModelIndex modelIdx = index(actionIdx, 0);
-                        emit dataChanged(modelIdx, modelIdx);
-                    }
-                }
-            });
-
-            connect(a, &QAction::destroyed, this, &AppMenuModel::modelNeedsUpdate);
-
-            if (a->menu()) {
-                m_importer->updateMenu(a->menu());
-            }
+        m_menu = m_importer->menu();
+        if (m_menu.isNull() || menu != m_menu) {
+            return;
         }
 
         setMenuAvailable(true);
         emit modelNeedsUpdate();
+
+        if (m_prefetchPolicy == InternalSettings::PrefetchEager) {
+            // Queued after update(), so it sees the new actions.
+            QMetaObject::invokeMethod(this, &AppMenuModel::prefetchMenus, Qt::QueuedConnection);
+        }
     });
 
-    connect(m_importer.data(), &DBusMenuImporter::actionActivationRequested, this, [this](QAction *action) {
-        // TODO submenus
-        if (!m_menuAvailable || !m_menu) {
+    connect(m_importer.data(), &DBusMenuImporter::menuLayoutChanged, this, [this](QMenu *menu) {
+        // Only the submenus the application reported as changed are
+        // fetched again, according to the prefetch policy.
+        if (menu == m_importer->menu()) {
+            m_revision++;
             return;
         }
+        auto it = m_prefetchedRevision.find(menu);
+        if (it != m_prefetchedRevision.end()) {
+            *it = 0;
+        }
+    });
 
-        const auto actions = m_menu->actions();
-        auto it = std::find(actions.begin(), actions.end(), action);
-        if (it != actions.end()) {
-            emit requestActivateIndex(it - actions.begin());
+    connect(m_importer.data(), &DBusMenuImporter::actionActivationRequested, this, [this](QAction *action) {
+        // TODO submenus
+        const int row = rowForAction(action);
+        if (row > -1) {
+            emit requestActivateIndex(row);
         }
     });
 }
@@ -26,11 +26,17 @@
 #include <QAbstractNativeEventFilter>
 #include <QAction>
 #include <QDBusServiceWatcher>
+#include <QHash>
 #include <QMenu>
 #include <QModelIndex>
 #include <QPointer>
 #include <QRect>
+#include <QSet>
 #include <QStringList>
+#include <QVector>
+
+// libdbusmenuqt
+#include <dbusmenuimporter.h>
 
 
 namespace Material
@@ -72,6 +78,15 @@ public:
     QVariant winId() const;
     void setWinId(const QVariant &id);
 
+    // InternalSettings::EnumMenuPrefetch
+    int prefetchPolicy() const;
+    void setPrefetchPolicy(int policy);
+
+public Q_SLOTS:
+    // Asks the application to populate the top level submenus that changed
+    // since they were last fetched, unless the policy is PrefetchOnOpen.
+    void prefetchMenus();
+
 signals:
     void requestActivateIndex(int index);
 
@@ -83,6 +98,8 @@ private Q_SLOTS:
     void onX11WindowChanged(WId id);
     void onX11WindowRemoved(WId id);
 
+    // Diffs the top level actions against m_actions, and emits the
+    // matching row signals. Resets the model if the menu was replaced.
     void update();
 
 signals:
@@ -91,7 +108,14 @@ signals:
     void winIdChanged();
 
 private:
-    bool m_menuAvailable;
+    DBusMenuImporter::ImportMode importMode() const;
+    void watchAction(QAction *a);
+    void prefetchNext();
+    void resetPrefetch();
+    void updateRows(int first, int last);
+    int rowForAction(QAction *a) const;
+
+    bool m_menuAvailable = false;
     bool m_updatePending = false;
 
     QVariant m_winId{-1};
@@ -101,11 +125,27 @@ private:
 
     QPointer<QMenu> m_menu;
 
+    // The rows of the model, ie: the top level actions of m_actionsMenu at
+    // the last update().
+    QVector<QAction *> m_actions;
+    // Row of each action in m_actions, kept in sync on every layout change.
+    QHash<QAction *, int> m_rows;
+    QMenu *m_actionsMenu = nullptr;
+
     QDBusServiceWatcher *m_serviceWatcher;
     QString m_serviceName;
     QString m_menuObjectPath;
 
     QPointer<KDBusMenuImporter> m_importer;
+
+    int m_prefetchPolicy;
+    // Bumped when the application reports that the whole menu changed.
+    uint m_revision = 1;
+    // Revision at which each submenu was last fetched, 0 once the
+    // application reports that the submenu changed.
+    QHash<QMenu *, uint> m_prefetchedRevision;
+    QVector<QPointer<QMenu>> m_prefetchQueue;
+    QSet<QMenu *> m_prefetching;
 };
 
 } // namespace Material
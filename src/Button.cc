@@ -20,6 +20,8 @@
 #include "Button.h"
 #include "Material.h"
 #include "Decoration.h"
+#include "GlyphAtlas.h"
+#include "QualityGovernor.h"
 
 #include "AppIconButton.h"
 #include "ApplicationMenuButton.h"
@@ -37,35 +39,29 @@
 #include <KDecoration2/Decoration>
 #include <KDecoration2/DecorationButton>
 
-// KF
-#include <KColorUtils>
-
 // Qt
 #include <QDebug>
 #include <QMargins>
 #include <QPainter>
-#include <QVariantAnimation>
 #include <QtMath> // qFloor
 
 
 namespace Material
 {
 
+// Distinct foreground colours in a hover or press transition.
+static const int s_foregroundSteps = 16;
+
 Button::Button(KDecoration2::DecorationButtonType type, Decoration *decoration, QObject *parent)
     : DecorationButton(type, decoration, parent)
     , m_animationEnabled(true)
-    , m_animation(new QVariantAnimation(this))
+    , m_animationDuration(0)
     , m_opacity(1)
     , m_transitionValue(0)
-    , m_padding(new QMargins())
     , m_isGtkButton(false)
+    , m_forceHovered(false)
+    , m_forcePressed(false)
 {
-    connect(this, &Button::hoveredChanged, this,
-        [this](bool hovered) {
-            updateAnimationState(hovered);
-            update();
-        });
-
     if (QCoreApplication::applicationName() == QStringLiteral("kded5")) {
         // See: https://github.com/Zren/material-decoration/issues/22
         // kde-gtk-config has a kded5 module which renders the buttons to svgs for gtk.
@@ -77,30 +73,14 @@ Button::Button(KDecoration2::DecorationButtonType type, Decoration *decoration,
     // The GTK bridge needs animations disabled to render hover states. See Issue #50.
     // https://invent.kde.org/plasma/kde-gtk-config/-/blob/master/kded/kwin_bridge/dummydecorationbridge.cpp#L35
     m_animationEnabled = !m_isGtkButton && decoration->animationsEnabled();
-    m_animation->setDuration(decoration->animationsDuration());
-    m_animation->setStartValue(0.0);
-    m_animation->setEndValue(1.0);
-    m_animation->setEasingCurve(QEasingCurve::InOutQuad);
-    connect(m_animation, &QVariantAnimation::valueChanged, this, [this](const QVariant &value) {
-        setTransitionValue(value.toReal());
-    });
-    connect(this, &Button::transitionValueChanged, this, [this]() {
-        update();
-    });
-
-    connect(this, &Button::opacityChanged, this, [this]() {
-        update();
-    });
+    m_animationDuration = decoration->animationsDuration();
 
     setHeight(decoration->titleBarHeight());
 
     auto *decoratedClient = decoration->client().toStrongRef().data();
 
+    // Only wire up the visibility here, see initShown().
     switch (type) {
-    case KDecoration2::DecorationButtonType::Menu:
-        AppIconButton::init(this, decoratedClient);
-        break;
-
     case KDecoration2::DecorationButtonType::ApplicationMenu:
         ApplicationMenuButton::init(this, decoratedClient);
         break;
@@ -140,6 +120,18 @@ Button::Button(KDecoration2::DecorationButtonType type, Decoration *decoration,
     default:
         break;
     }
+
+    if (isVisible()) {
+        initShown();
+    } else {
+        m_shownConnection = connect(this, &Button::visibilityChanged, this,
+            [this](bool visible) {
+                if (visible) {
+                    QObject::disconnect(m_shownConnection);
+                    initShown();
+                }
+            });
+    }
 }
 
 Button::~Button()
@@ -176,6 +168,22 @@ Button::Button(QObject *parent, const QVariantList &args)
 {
 }
 
+void Button::initShown()
+{
+    // Buttons that stay hidden, eg: maximize on a dialog, are never hovered
+    // or painted, so they skip this.
+    connect(this, &Button::hoveredChanged, this,
+        [this](bool hovered) {
+            updateAnimationState(hovered);
+            update();
+        });
+
+    if (type() == KDecoration2::DecorationButtonType::Menu) {
+        auto *decoratedClient = decoration()->client().toStrongRef().data();
+        AppIconButton::init(this, decoratedClient);
+    }
+}
+
 void Button::paint(QPainter *painter, const QRect &repaintRegion)
 {
     Q_UNUSED(repaintRegion)
@@ -224,11 +232,25 @@ void Button::paint(QPainter *painter, const QRect &repaintRegion)
     painter->drawRoundedRect(buttonRect, 5, 5);
 
     // Foreground.
+    const QColor foreground = foregroundColor();
+    painter->setPen(foreground);
     setPenWidth(painter, gridUnit, 1);
     painter->setBrush(Qt::NoBrush);
-
+    painter->setRenderHints(QPainter::Antialiasing, m_isGtkButton || QualityGovernor::self()->glyphAntialiasing());
 
     // Icon
+    // The GTK bridge renders into svgs, so keep the vector paths there.
+    if (!m_isGtkButton && GlyphAtlas::supports(type())) {
+        GlyphAtlas::paint(this, painter, iconRect, gridUnit, foreground);
+    } else {
+        paintIconForType(painter, iconRect, gridUnit);
+    }
+
+    painter->restore();
+}
+
+void Button::paintIconForType(QPainter *painter, const QRectF &iconRect, const qreal gridUnit)
+{
     switch (type()) {
     case KDecoration2::DecorationButtonType::Menu:
         AppIconButton::paintIcon(this, painter, iconRect, gridUnit);
@@ -274,8 +296,6 @@ void Button::paint(QPainter *painter, const QRect &repaintRegion)
         paintIcon(painter, iconRect, gridUnit);
         break;
     }
-
-    painter->restore();
 }
 
 void Button::paintIcon(QPainter *painter, const QRectF &iconRect, const qreal gridUnit)
@@ -288,8 +308,8 @@ void Button::paintIcon(QPainter *painter, const QRectF &iconRect, const qreal gr
 void Button::updateSize(int contentWidth, int contentHeight)
 {
     const QSize size(
-        m_padding->left() + contentWidth + m_padding->right(),
-        m_padding->top() + contentHeight + m_padding->bottom()
+        m_padding.left() + contentWidth + m_padding.right(),
+        m_padding.top() + contentHeight + m_padding.bottom()
     );
     setGeometry(QRect(geometry().topLeft().toPoint(), size));
 }
@@ -308,7 +328,9 @@ qreal Button::iconLineWidth(const qreal gridUnit) const
 
 void Button::setPenWidth(QPainter *painter, const qreal gridUnit, const qreal scale)
 {
-    QPen pen(foregroundColor());
+    // Keep the pen colour chosen by paint(), which is foregroundColor()
+    // except when rasterizing an alpha mask for the GlyphAtlas.
+    QPen pen(painter->pen().color());
     pen.setCapStyle(Qt::RoundCap);
     pen.setJoinStyle(Qt::MiterJoin);
     pen.setWidthF(iconLineWidth(gridUnit) * scale);
@@ -327,69 +349,15 @@ QColor Button::backgroundColor() const
         // when we just change the fgColor on hover instead of the bgColor.
        //return Qt::transparent;
     //}
-    //--- CloseButton
-    if (type() == KDecoration2::DecorationButtonType::Close) {
-        auto *decoratedClient = deco->client().toStrongRef().data();
-        const QColor hoveredColor = decoratedClient->color(
-            KDecoration2::ColorGroup::Warning,
-            KDecoration2::ColorRole::Foreground
-        );
-        QColor normalColor = QColor(hoveredColor);
-        normalColor.setAlphaF(0);
-
-        if (isPressed()) {
-            const QColor pressedColor = decoratedClient->color(
-                KDecoration2::ColorGroup::Warning,
-                KDecoration2::ColorRole::Foreground
-            ).lighter();
-            return KColorUtils::mix(normalColor, pressedColor, m_transitionValue);
-        }
+    const auto &colors = deco->buttonColors(this).background;
 
-        if (isHovered()) {
-            return KColorUtils::mix(normalColor, hoveredColor, m_transitionValue);
-        }
+    if (m_forcePressed || isPressed()) {
+        return interpolateColor(colors.normal, colors.pressed, m_transitionValue);
     }
-
-    //--- Checked
-    if (isChecked() && type() != KDecoration2::DecorationButtonType::Maximize) {
-        const QColor normalColor = deco->titleBarForegroundColor();
-
-        if (isPressed()) {
-            const QColor pressedColor = KColorUtils::mix(
-                deco->titleBarBackgroundColor(),
-                deco->titleBarForegroundColor(),
-                0.7);
-            return KColorUtils::mix(normalColor, pressedColor, m_transitionValue);
-        }
-        if (isHovered()) {
-            const QColor hoveredColor = KColorUtils::mix(
-                deco->titleBarBackgroundColor(),
-                deco->titleBarForegroundColor(),
-                0.8);
-            return KColorUtils::mix(normalColor, hoveredColor, m_transitionValue);
-        }
-        return normalColor;
-    }
-
-    //--- Normal
-    const QColor hoveredColor = KColorUtils::mix(
-        deco->titleBarBackgroundColor(),
-        deco->titleBarForegroundColor(),
-        0.2);
-    QColor normalColor = QColor(hoveredColor);
-    normalColor.setAlphaF(0);
-
-    if (isPressed()) {
-        const QColor pressedColor = KColorUtils::mix(
-            deco->titleBarBackgroundColor(),
-            deco->titleBarForegroundColor(),
-            0.3);
-        return KColorUtils::mix(normalColor, pressedColor, m_transitionValue);
+    if (m_forceHovered || isHovered()) {
+        return interpolateColor(colors.normal, colors.hovered, m_transitionValue);
     }
-    if (isHovered()) {
-        return KColorUtils::mix(normalColor, hoveredColor, m_transitionValue);
-    }
-    return normalColor;
+    return QColor::fromRgba(qUnpremultiply(colors.normal));
 }
 
 QColor Button::foregroundColor() const
@@ -399,73 +367,53 @@ QColor Button::foregroundColor() const
         return {};
     }
 
-    //--- Checked
-    if (isChecked() && type() != KDecoration2::DecorationButtonType::Maximize) {
-        const QColor activeColor = KColorUtils::mix(
-            deco->titleBarBackgroundColor(),
-            deco->titleBarForegroundColor(),
-            0.2);
-
-        if (isPressed() || isHovered()) {
-            return KColorUtils::mix(
-                activeColor,
-                deco->titleBarBackgroundColor(),
-                m_transitionValue);
-        }
-        return activeColor;
-    }
+    const auto &colors = deco->buttonColors(this).foreground;
 
-    //--- Normal
-    const QColor normalColor = KColorUtils::mix(
-        deco->titleBarBackgroundColor(),
-        deco->titleBarForegroundColor(),
-        0.8);
+    // The GlyphAtlas keeps a tinted glyph per colour, so only use a few
+    // steps of the transition for the glyph to make animation frames hit it.
+    const qreal progress = qRound(m_transitionValue * s_foregroundSteps) / static_cast<qreal>(s_foregroundSteps);
 
-    if (isPressed() || isHovered()) {
-        // Breeze GTK has huge margins around the button. It looks better
-        // when we just change the fgColor on hover instead of the bgColor.
-        QColor hoveredColor;
-        //  if (type() == KDecoration2::DecorationButtonType::Close) {
-        //      auto *decoratedClient = deco->client().toStrongRef().data();
-        //      hoveredColor = decoratedClient->color(
-        //          KDecoration2::ColorGroup::Warning,
-        //          KDecoration2::ColorRole::Foreground
-        //      );
-        // } else if (type() == KDecoration2::DecorationButtonType::Maximize) {
-        //     const int grayValue = qGray(deco->titleBarBackgroundColor().rgb());
-        //     if (grayValue < 128) { // Dark Bg
-        //         hoveredColor = QColor(100, 196, 86); // from SierraBreeze
-        //     } else { // Light Bg
-        //         hoveredColor = QColor(40, 200, 64); // from SierraBreeze
-        //     }
-        // } else if (type() == KDecoration2::DecorationButtonType::Minimize) {
-        //     const int grayValue = qGray(deco->titleBarBackgroundColor().rgb());
-        //     if (grayValue < 128) {
-        //         hoveredColor = QColor(223, 192, 76); // from SierraBreeze
-        //     } else { // Light Bg
-        //         hoveredColor = QColor(255, 188, 48); // from SierraBreeze
-        //     }
-        //  } else {
-            hoveredColor = deco->titleBarForegroundColor();
-        // }
-
-        return KColorUtils::mix(
-            normalColor,
-            hoveredColor,
-            m_transitionValue);
+    if (m_forcePressed || isPressed()) {
+        return interpolateColor(colors.normal, colors.pressed, progress);
+    }
+    if (m_forceHovered || isHovered()) {
+        return interpolateColor(colors.normal, colors.hovered, progress);
+    }
+    return QColor::fromRgba(qUnpremultiply(colors.normal));
+}
+
+QColor Button::interpolateColor(QRgb from, QRgb to, qreal progress)
+{
+    if (progress <= 0 || from == to) {
+        return QColor::fromRgba(qUnpremultiply(from));
+    }
+    if (progress >= 1) {
+        return QColor::fromRgba(qUnpremultiply(to));
     }
 
-    return normalColor;
+    const int t = qRound(progress * 256);
+    auto lerp = [t] (int a, int b) -> int {
+        return a + (b - a) * t / 256;
+    };
+
+    // Keep the result a valid premultiplied colour despite rounding.
+    const int alpha = lerp(qAlpha(from), qAlpha(to));
+    return QColor::fromRgba(qUnpremultiply(qRgba(
+        qMin(lerp(qRed(from), qRed(to)), alpha),
+        qMin(lerp(qGreen(from), qGreen(to)), alpha),
+        qMin(lerp(qBlue(from), qBlue(to)), alpha),
+        alpha
+    )));
 }
 
 
 QRectF Button::contentArea() const
 {
     return geometry().adjusted(
-        m_padding->left(),
-        m_padding->top(),
-        -m_padding->right(),
-        -m_padding->bottom()
+        m_padding.left(),
+        m_padding.top(),
+        -m_padding.right(),
+        -m_padding.bottom()
     );
 }
 
@@ -478,19 +426,27 @@ void Button::setAnimationEnabled(bool value)
 {
     if (m_animationEnabled != value) {
         m_animationEnabled = value;
+        if (!value && m_transition) {
+            // Nothing keeps ticking once animations are off, eg: when the
+            // QualityGovernor degrades.
+            m_transition->finish();
+        }
         emit animationEnabledChanged();
     }
 }
 
 int Button::animationDuration() const
 {
-    return m_animation->duration();
+    return m_animationDuration;
 }
 
 void Button::setAnimationDuration(int value)
 {
-    if (m_animation->duration() != value) {
-        m_animation->setDuration(value);
+    if (m_animationDuration != value) {
+        m_animationDuration = value;
+        if (m_transition) {
+            m_transition->setDuration(value);
+        }
         emit animationDurationChanged();
     }
 }
@@ -523,7 +479,7 @@ void Button::setTransitionValue(qreal value)
 
 QMargins* Button::padding()
 {
-    return m_padding;
+    return &m_padding;
 }
 
 void Button::setHorzPadding(int value)
@@ -541,14 +497,19 @@ void Button::setVertPadding(int value)
 void Button::updateAnimationState(bool hovered)
 {
     if (m_animationEnabled) {
-        QAbstractAnimation::Direction dir = hovered ? QAbstractAnimation::Forward : QAbstractAnimation::Backward;
-        if (m_animation->state() == QAbstractAnimation::Running && m_animation->direction() != dir) {
-            m_animation->stop();
-        }
-        m_animation->setDirection(dir);
-        if (m_animation->state() != QAbstractAnimation::Running) {
-            m_animation->start();
+        // Most buttons are never hovered (hidden types, dialogs that close
+        // quickly), so the transition is only created on first hover.
+        if (!m_transition) {
+            // The AnimationDriver repaints the button while the transition
+            // runs, and the AppMenuButtonGroup repaints the titlebar when it
+            // changes our opacity.
+            m_transition.reset(new Transition(decoration(), [this](qreal value) {
+                setTransitionValue(value);
+                return geometry().toAlignedRect();
+            }));
+            m_transition->setDuration(m_animationDuration);
         }
+        m_transition->start(hovered ? QAbstractAnimation::Forward : QAbstractAnimation::Backward);
     } else {
         setTransitionValue(1);
     }
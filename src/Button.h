@@ -18,14 +18,18 @@
 
 #pragma once
 
+// own
+#include "AnimationDriver.h"
+
 // KDecoration
 #include <KDecoration2/Decoration>
 #include <KDecoration2/DecorationButton>
 
 // Qt
+#include <QColor>
 #include <QMargins>
 #include <QRectF>
-#include <QVariantAnimation>
+#include <QScopedPointer>
 
 namespace Material
 {
@@ -56,6 +60,7 @@ public:
 
 
     void paint(QPainter *painter, const QRect &repaintRegion) override;
+    void paintIconForType(QPainter *painter, const QRectF &iconRect, const qreal gridUnit);
     virtual void paintIcon(QPainter *painter, const QRectF &iconRect, const qreal gridUnit);
 
     virtual void updateSize(int contentWidth, int contentHeight);
@@ -67,6 +72,9 @@ public:
     virtual QColor backgroundColor() const;
     virtual QColor foregroundColor() const;
 
+    // Linear interpolation between two premultiplied colours.
+    static QColor interpolateColor(QRgb from, QRgb to, qreal progress);
+
     QRectF contentArea() const;
 
     bool animationEnabled() const;
@@ -96,12 +104,24 @@ signals:
     void paddingChanged();
 
 private:
+    // Connections and state only needed once the button is visible.
+    void initShown();
+
+    QMetaObject::Connection m_shownConnection;
     bool m_animationEnabled;
-    QVariantAnimation *m_animation;
+    int m_animationDuration;
+    QScopedPointer<Transition> m_transition;
     qreal m_opacity;
     qreal m_transitionValue;
-    QMargins *m_padding;
+    QMargins m_padding;
     bool m_isGtkButton;
+
+    // Set by ButtonAssetExporter to paint the hover and pressed states,
+    // as a disabled button ignores the events that would change them.
+    bool m_forceHovered;
+    bool m_forcePressed;
+
+    friend class ButtonAssetExporter;
 };
 
 } // namespace Material
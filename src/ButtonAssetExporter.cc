@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2020 Chris Holland <zrenfire@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// own
+#include "ButtonAssetExporter.h"
+#include "Material.h"
+#include "Button.h"
+#include "Decoration.h"
+
+// KDecoration
+#include <KDecoration2/DecorationButton>
+
+// Qt
+#include <QBuffer>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QPainter>
+#include <QSvgGenerator>
+#include <QVector>
+
+
+namespace Material
+{
+
+namespace
+{
+
+struct ButtonAsset
+{
+    KDecoration2::DecorationButtonType type;
+    bool checked;
+    const char *name;
+};
+
+// The names kde-gtk-config gives the assets, plus the restore button.
+const ButtonAsset s_buttonAssets[] = {
+    { KDecoration2::DecorationButtonType::Close, false, "close" },
+    { KDecoration2::DecorationButtonType::Minimize, false, "minimize" },
+    { KDecoration2::DecorationButtonType::Maximize, false, "maximize" },
+    { KDecoration2::DecorationButtonType::Maximize, true, "maximized" },
+};
+
+const char *const s_assetDirectories[] = {
+    "gtk-3.0/assets",
+    "gtk-4.0/assets",
+};
+
+// Indexed by ButtonAssetExporter::ButtonState
+const char *const s_stateNames[] = { "normal", "hover", "active" };
+
+QByteArray renderSvg(Button *button, int size)
+{
+    QBuffer buffer;
+    QSvgGenerator generator;
+    generator.setOutputDevice(&buffer);
+    generator.setSize(QSize(size, size));
+    generator.setViewBox(QRect(0, 0, size, size));
+
+    QPainter painter(&generator);
+    button->paint(&painter, QRect(0, 0, size, size));
+    painter.end();
+
+    return buffer.data();
+}
+
+} // anonymous namespace
+
+void ButtonAssetExporter::setButtonState(Button *button, ButtonState state)
+{
+    // Set the state directly instead of sending hover and mouse events,
+    // which a disabled button (eg: maximize on a fixed size window) ignores.
+    button->m_forceHovered = state != NormalState;
+    button->m_forcePressed = state == PressedState;
+    button->setTransitionValue(state == NormalState ? 0 : 1);
+}
+
+bool ButtonAssetExporter::exportAll(Decoration *decoration, const QString &configDirectory, const QList<int> &sizes)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // Directories to write each size to, the first size directly in assets/
+    QVector<QStringList> sizeDirectories;
+    for (int i = 0; i < sizes.size(); ++i) {
+        QStringList directories;
+        for (const char *assetDirectory : s_assetDirectories) {
+            QString directory = QStringLiteral("%1/%2").arg(configDirectory, QLatin1String(assetDirectory));
+            if (i > 0) {
+                directory += QStringLiteral("/%1x%1").arg(sizes.at(i));
+            }
+            if (QDir().mkpath(directory)) {
+                directories << directory;
+            } else {
+                qCWarning(category) << "ButtonAssetExporter: could not create" << directory;
+            }
+        }
+        sizeDirectories << directories;
+    }
+
+    QVector<Button *> buttons;
+    for (const ButtonAsset &asset : s_buttonAssets) {
+        auto *button = new Button(asset.type, decoration, decoration);
+        // Use the larger GTK icon size and paint each state without animating.
+        button->m_isGtkButton = true;
+        button->setAnimationEnabled(false);
+        button->setVisible(true);
+        button->setChecked(asset.checked);
+        buttons.append(button);
+    }
+
+    const int expected = buttons.size() * 2 * 3 * sizes.size()
+        * static_cast<int>(sizeof(s_assetDirectories) / sizeof(s_assetDirectories[0]));
+    QStringList missing;
+    int count = 0;
+
+    for (const bool active : { true, false }) {
+        decoration->updateColorsForState(active);
+        const QString activePrefix = active ? QString() : QStringLiteral("backdrop-");
+
+        for (int sizeIndex = 0; sizeIndex < sizes.size(); ++sizeIndex) {
+            const int size = sizes.at(sizeIndex);
+
+            for (int i = 0; i < buttons.size(); ++i) {
+                Button *button = buttons.at(i);
+                button->setGeometry(QRectF(0, 0, size, size));
+
+                for (const ButtonState state : { NormalState, HoverState, PressedState }) {
+                    setButtonState(button, state);
+                    const QByteArray svg = renderSvg(button, size);
+
+                    const QString fileName = QStringLiteral("%1-%2%3.svg")
+                        .arg(QLatin1String(s_buttonAssets[i].name), activePrefix, QLatin1String(s_stateNames[state]));
+                    for (const QString &directory : sizeDirectories.at(sizeIndex)) {
+                        QFile file(QStringLiteral("%1/%2").arg(directory, fileName));
+                        if (file.open(QIODevice::WriteOnly) && file.write(svg) == svg.size()) {
+                            count++;
+                        } else {
+                            missing << file.fileName();
+                        }
+                    }
+                }
+                setButtonState(button, NormalState);
+            }
+        }
+    }
+
+    qDeleteAll(buttons);
+
+    // Back to the palette of the real window state.
+    decoration->updateColors();
+
+    if (count != expected) {
+        qCWarning(category) << "ButtonAssetExporter: wrote" << count << "of" << expected << "files, missing:" << missing;
+        return false;
+    }
+
+    qCDebug(category) << "ButtonAssetExporter: wrote" << count << "files in" << timer.elapsed() << "ms";
+    return true;
+}
+
+} // namespace Material
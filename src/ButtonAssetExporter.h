@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2020 Chris Holland <zrenfire@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Qt
+#include <QList>
+#include <QString>
+
+namespace Material
+{
+
+class Button;
+class Decoration;
+
+// Renders the titlebar buttons kde-gtk-config uses as GTK headerbar button
+// assets into SVG files in one pass, for kde-gtk-config to call through
+// Decoration::exportButtonAssets() instead of painting each button itself.
+//
+// The buttons are created once and painted for every state and size with
+// the same decoration, and the palette is only rebuilt once for the active
+// state and once for the inactive (backdrop) state. Each image is rendered
+// once and written with kde-gtk-config's file names into both
+//     <configDirectory>/gtk-3.0/assets/<name>-[backdrop-]<normal|hover|active>.svg
+//     <configDirectory>/gtk-4.0/assets/<name>-[backdrop-]<normal|hover|active>.svg
+// for the first size, and into assets/<size>x<size>/ for the others, where
+// <name> is close, minimize, maximize or maximized.
+class ButtonAssetExporter
+{
+public:
+    // Returns false, after logging what is missing, unless every asset
+    // was written to every directory.
+    static bool exportAll(Decoration *decoration, const QString &configDirectory, const QList<int> &sizes);
+
+private:
+    enum ButtonState {
+        NormalState,
+        HoverState,
+        PressedState,
+    };
+
+    static void setButtonState(Button *button, ButtonState state);
+};
+
+} // namespace Material
@@ -56,6 +56,7 @@ ConfigurationModule::ConfigurationModule(QWidget *parent, const QVariantList &ar
     : KCModule(parent, args)
     , m_titleAlignment(InternalSettings::AlignCenterFullWidth)
     , m_buttonSize(InternalSettings::ButtonDefault)
+    , m_menuPrefetch(InternalSettings::PrefetchOnHover)
     , m_shadowSize(InternalSettings::ShadowVeryLarge)
 {
     init();
@@ -155,6 +156,13 @@ void ConfigurationModule::init()
     menuButtonHorzPadding->setObjectName(QStringLiteral("kcfg_MenuButtonHorzPadding"));
     menuForm->addRow(i18n("Padding:"), menuButtonHorzPadding);
 
+    QComboBox *menuPrefetch = new QComboBox(menuTab);
+    menuPrefetch->addItem(i18n("When the menu changes"));
+    menuPrefetch->addItem(i18n("When hovering or focusing the window"));
+    menuPrefetch->addItem(i18n("When a menu is opened"));
+    menuPrefetch->setObjectName(QStringLiteral("kcfg_MenuPrefetch"));
+    menuForm->addRow(i18n("Load submenus:"), menuPrefetch);
+
 
     //--- Animations
     QWidget *animationsTab = new QWidget(tabWidget);
@@ -174,6 +182,19 @@ void ConfigurationModule::init()
     animationsDuration->setObjectName(QStringLiteral("kcfg_AnimationsDuration"));
     animationsForm->addRow(i18nd("breeze_kwin_deco", "Animations:"), animationsDuration);
 
+    QCheckBox *adaptiveQuality = new QCheckBox(animationsTab);
+    adaptiveQuality->setText(i18n("Reduce quality when painting is slow"));
+    adaptiveQuality->setObjectName(QStringLiteral("kcfg_AdaptiveQuality"));
+    animationsForm->addRow(QStringLiteral(""), adaptiveQuality);
+
+    QSpinBox *paintBudget = new QSpinBox(animationsTab);
+    paintBudget->setMinimum(100);
+    paintBudget->setMaximum(100000);
+    paintBudget->setSingleStep(100);
+    paintBudget->setSuffix(i18n(" µs"));
+    paintBudget->setObjectName(QStringLiteral("kcfg_PaintBudget"));
+    animationsForm->addRow(i18n("Paint budget:"), paintBudget);
+
 
     //--- Shadows
     QWidget *shadowTab = new QWidget(tabWidget);
@@ -244,6 +265,12 @@ void ConfigurationModule::init()
         1,
         QStringLiteral("MenuButtonHorzPadding")
     );
+    skel->addItemInt(
+        QStringLiteral("MenuPrefetch"),
+        m_menuPrefetch,
+        InternalSettings::PrefetchOnHover,
+        QStringLiteral("MenuPrefetch")
+    );
     skel->addItemBool(
         QStringLiteral("AnimationsEnabled"),
         m_animationsEnabled,
@@ -256,6 +283,18 @@ void ConfigurationModule::init()
         150,
         QStringLiteral("AnimationsDuration")
     );
+    skel->addItemBool(
+        QStringLiteral("AdaptiveQuality"),
+        m_adaptiveQuality,
+        false,
+        QStringLiteral("AdaptiveQuality")
+    );
+    skel->addItemInt(
+        QStringLiteral("PaintBudget"),
+        m_paintBudget,
+        2000,
+        QStringLiteral("PaintBudget")
+    );
     skel->addItemInt(
         QStringLiteral("ShadowSize"),
         m_shadowSize,
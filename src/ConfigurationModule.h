@@ -42,8 +42,11 @@ private:
     bool m_blurEnabled;
     bool m_menuAlwaysShow;
     int m_menuButtonHorzPadding;
+    int m_menuPrefetch;
     bool m_animationsEnabled;
     int m_animationsDuration;
+    bool m_adaptiveQuality;
+    int m_paintBudget;
     int m_shadowSize;
     int m_shadowStrength;
     QColor m_shadowColor;
@@ -47,7 +47,6 @@ public:
     static void paintIcon(Button *button, QPainter *painter, const QRectF &iconRect, const qreal gridUnit) {
         button->setPenWidth(painter, gridUnit, 1.25);
 
-        painter->setRenderHints(QPainter::Antialiasing, true);
         painter->translate( iconRect.topLeft() );
 
         const QRectF topCurveRect = QRectF(
@@ -22,10 +22,14 @@
 #include "Decoration.h"
 #include "Material.h"
 #include "BuildConfig.h"
+#include "AppIconButton.h"
 #include "AppMenuButtonGroup.h"
 #include "BoxShadowHelper.h"
 #include "Button.h"
+#include "ButtonAssetExporter.h"
 #include "InternalSettings.h"
+#include "QualityGovernor.h"
+#include "ThemedIconCache.h"
 
 // KDecoration
 #include <KDecoration2/DecoratedClient>
@@ -35,14 +39,17 @@
 #include <KDecoration2/DecorationShadow>
 
 // KF
+#include <KColorUtils>
 #include <KWindowSystem>
 
 // Qt
 #include <QApplication>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QHoverEvent>
 #include <QMouseEvent>
 #include <QPainter>
+#include <QPainterPath>
 #include <QRegion>
 #include <QSharedPointer>
 #include <QWheelEvent>
@@ -57,6 +64,8 @@
 #include <xcb/xcb.h>
 #endif
 
+//#define BENCHMARK
+
 namespace Material
 {
 
@@ -153,9 +162,22 @@ static int s_shadowStrength = 255;
 static QColor s_shadowColor = QColor(33, 33, 33);
 static QSharedPointer<KDecoration2::DecorationShadow> s_cachedShadow;
 
+#ifdef BENCHMARK
+// Number of DecoratedClient::color() calls, and number of palette reads by
+// the paint code, over the last s_benchmarkPaints paints. Before the palette
+// was cached, every read was a color() call, so to compare with that tree
+// count its color() calls from borderColor(), titleBarBackgroundColor(),
+// titleBarForegroundColor() and Button::backgroundColor() the same way.
+static const int s_benchmarkPaints = 100;
+static int s_paints = 0;
+static int s_colorLookups = 0;
+static int s_colorReads = 0;
+#endif
+
 Decoration::Decoration(QObject *parent, const QVariantList &args)
     : KDecoration2::Decoration(parent, args)
     , m_internalSettings(nullptr)
+    , m_opaque(false)
 {
     ++s_decoCount;
 }
@@ -164,6 +186,9 @@ Decoration::~Decoration()
 {
     if (--s_decoCount == 0) {
         s_cachedShadow.clear();
+        QualityGovernor::release();
+        AppIconButton::clearCache();
+        ThemedIconCache::release();
     }
 }
 
@@ -192,6 +217,12 @@ QRect Decoration::centerRect() const
 
 void Decoration::paint(QPainter *painter, const QRect &repaintRegion)
 {
+    auto *governor = QualityGovernor::self();
+    QElapsedTimer paintTimer;
+    if (governor->isEnabled()) {
+        paintTimer.start();
+    }
+
     auto *decoratedClient = client().toStrongRef().data();
 
     if (!decoratedClient->isShaded()) {
@@ -206,7 +237,25 @@ void Decoration::paint(QPainter *painter, const QRect &repaintRegion)
     if (settings()->borderSize() >= KDecoration2::BorderSize::Normal) {
         paintOutline(painter, repaintRegion);
     }
-    updateBlur();
+
+    if (paintTimer.isValid()) {
+        governor->addPaintTime(paintTimer.nsecsElapsed());
+    }
+
+#ifdef BENCHMARK
+    if (++s_paints == s_benchmarkPaints) {
+        qCDebug(category) << "Decoration::paint" << s_paints << "paints"
+            << "color() calls:" << s_colorLookups << "palette reads:" << s_colorReads;
+        s_paints = 0;
+        s_colorLookups = 0;
+        s_colorReads = 0;
+    }
+#endif
+}
+
+bool Decoration::exportButtonAssets(const QString &configDirectory, const QList<int> &sizes)
+{
+    return ButtonAssetExporter::exportAll(this, configDirectory, sizes);
 }
 
 void Decoration::init()
@@ -215,6 +264,13 @@ void Decoration::init()
 
     auto *decoratedClient = client().toStrongRef().data();
 
+    QualityGovernor::self()->configure(
+        m_internalSettings->adaptiveQuality(),
+        m_internalSettings->paintBudget());
+
+    updateOpaque();
+    updateColors();
+
     auto repaintTitleBar = [this] {
         update(titleBar());
     };
@@ -257,14 +313,34 @@ void Decoration::init()
 
     connect(decoratedClient, &KDecoration2::DecoratedClient::captionChanged,
             this, repaintTitleBar);
+    connect(decoratedClient, &KDecoration2::DecoratedClient::activeChanged,
+            this, &Decoration::updateColors);
     connect(decoratedClient, &KDecoration2::DecoratedClient::activeChanged,
             this, repaintTitleBar);
+    connect(decoratedClient, &KDecoration2::DecoratedClient::paletteChanged,
+            this, &Decoration::updateColors);
+    connect(decoratedClient, &KDecoration2::DecoratedClient::paletteChanged,
+            this, [this] {
+                update();
+            });
 
     updateBorders();
     updateResizeBorders();
     updateTitleBar();
     updateButtonsGeometry();
 
+    connect(this, &KDecoration2::Decoration::bordersChanged,
+            this, &Decoration::updateBlur);
+    connect(decoratedClient, &KDecoration2::DecoratedClient::widthChanged,
+            this, &Decoration::updateBlur);
+    connect(decoratedClient, &KDecoration2::DecoratedClient::heightChanged,
+            this, &Decoration::updateBlur);
+    connect(decoratedClient, &KDecoration2::DecoratedClient::activeChanged,
+            this, &Decoration::updateBlur);
+    connect(decoratedClient, &KDecoration2::DecoratedClient::shadedChanged,
+            this, &Decoration::updateBlur);
+    updateBlur();
+
     connect(this, &KDecoration2::Decoration::sectionUnderMouseChanged,
             this, &Decoration::onSectionUnderMouseChanged);
     updateTitleBarHoverState();
@@ -273,6 +349,10 @@ void Decoration::init()
     // the Window Decorations KCM crashes.
     updateShadow();
 
+    // Queued, as the level changes from within another decoration's paint().
+    connect(QualityGovernor::self(), &QualityGovernor::levelChanged,
+        this, &Decoration::updateQuality, Qt::QueuedConnection);
+
     connect(settings().data(), &KDecoration2::DecorationSettings::reconfigured,
         this, &Decoration::reconfigure);
     connect(m_internalSettings.data(), &InternalSettings::configChanged,
@@ -292,13 +372,20 @@ void Decoration::init()
 void Decoration::reconfigure()
 {
     m_internalSettings->load();
+    QualityGovernor::self()->configure(
+        m_internalSettings->adaptiveQuality(),
+        m_internalSettings->paintBudget());
 
+    updateOpaque();
+    updateColors();
     updateBorders();
     updateTitleBar();
     m_menuButtons->setAlwaysShow(m_internalSettings->menuAlwaysShow());
+    m_menuButtons->setMenuPrefetch(m_internalSettings->menuPrefetch());
     updateButtonsGeometry();
     updateButtonAnimation();
     updateShadow();
+    updateBlur();
     update();
 }
 
@@ -326,7 +413,6 @@ void Decoration::hoverEnterEvent(QHoverEvent *event)
 {
     KDecoration2::Decoration::hoverEnterEvent(event);
     qCDebug(category) << "Decoration::hoverEnterEvent" << event;
-    updateBlur();
     // m_menuButtons->setHovered(true);
 }
 
@@ -352,7 +438,6 @@ void Decoration::hoverMoveEvent(QHoverEvent *event)
     // } else if (wasHovered && contains) {
     //     // HoverMove
     // }
-    updateBlur();
 }
 
 void Decoration::mouseReleaseEvent(QMouseEvent *event)
@@ -361,7 +446,6 @@ void Decoration::mouseReleaseEvent(QMouseEvent *event)
     // qCDebug(category) << "Decoration::mouseReleaseEvent" << event;
 
     resetDragMove();
-    updateBlur();
 }
 
 void Decoration::hoverLeaveEvent(QHoverEvent *event)
@@ -370,7 +454,6 @@ void Decoration::hoverLeaveEvent(QHoverEvent *event)
     qCDebug(category) << "Decoration::hoverLeaveEvent" << event;
 
     resetDragMove();
-    updateBlur();
     // m_menuButtons->setHovered(false);
 }
 
@@ -398,10 +481,149 @@ void Decoration::onSectionUnderMouseChanged(const Qt::WindowFrameSection value)
 
 void Decoration::updateBlur()
 {
-    if (!m_internalSettings->blurEnabled()) return;
 #if HAVE_KDecoration2_5_25
-    setBlurRegion(QRegion(0, 0, size().width(), size().height()));
+    // Every setBlurRegion() makes KWin recompute the blur, so only
+    // send the region when it actually changes.
+    const QRegion region = blurRegionShape();
+    if (region != m_blurRegion) {
+        m_blurRegion = region;
+        setBlurRegion(region);
+    }
+#endif
+}
+
+QRegion Decoration::blurRegionShape() const
+{
+    const auto *decoratedClient = client().toStrongRef().data();
+    const qreal opacity = decoratedClient->isActive()
+        ? m_internalSettings->activeOpacity()
+        : m_internalSettings->inactiveOpacity();
+    if (!m_internalSettings->blurEnabled() || opacity >= 1) {
+        return QRegion();
+    }
+
+    // Match the shape painted by paintTitleBarBackground() and
+    // paintFrameBackground(), leaving out the client area.
+    QPainterPath path;
+    path.addRoundedRect(rect(), 5, 5);
+    QRegion region(path.toFillPolygon().toPolygon());
+
+    if (!decoratedClient->isShaded()) {
+        region |= QRegion(0, borderTop(), size().width(), size().height() - borderTop());
+    }
+
+    region -= QRect(
+        borderLeft(),
+        borderTop(),
+        size().width() - borderLeft() - borderRight(),
+        size().height() - borderTop() - borderBottom());
+
+    return region;
+}
+
+void Decoration::updateOpaque()
+{
+    // With no translucency configured, declare the decoration opaque so the
+    // compositor can skip painting what is behind it. Blur does not apply
+    // to fully opaque colours, see blurRegionShape().
+    m_opaque = m_internalSettings->activeOpacity() >= 1
+        && m_internalSettings->inactiveOpacity() >= 1;
+    setOpaque(m_opaque);
+}
+
+void Decoration::updateColors()
+{
+    const auto *decoratedClient = client().toStrongRef().data();
+    updateColorsForState(decoratedClient->isActive());
+}
+
+void Decoration::updateColorsForState(bool active)
+{
+    const auto *decoratedClient = client().toStrongRef().data();
+    const auto group = active
+        ? KDecoration2::ColorGroup::Active
+        : KDecoration2::ColorGroup::Inactive;
+    const qreal opacity = active
+        ? m_internalSettings->activeOpacity()
+        : m_internalSettings->inactiveOpacity();
+
+    m_colors.border = decoratedClient->color(group, KDecoration2::ColorRole::Frame);
+    m_colors.border.setAlphaF(opacity);
+
+    m_colors.titleBarBackground = decoratedClient->color(group, KDecoration2::ColorRole::TitleBar);
+    m_colors.titleBarBackground.setAlphaF(opacity);
+
+    m_colors.titleBarForeground = decoratedClient->color(group, KDecoration2::ColorRole::Foreground);
+
+    m_colors.warningForeground = decoratedClient->color(
+        KDecoration2::ColorGroup::Warning,
+        KDecoration2::ColorRole::Foreground
+    );
+
+#ifdef BENCHMARK
+    s_colorLookups += 4;
 #endif
+
+    updateButtonColors();
+}
+
+void Decoration::updateButtonColors()
+{
+    const QColor background = m_colors.titleBarBackground;
+    const QColor foreground = m_colors.titleBarForeground;
+
+    auto premultiplied = [] (const QColor &color) -> QRgb {
+        return qPremultiply(color.rgba());
+    };
+    auto mixed = [&] (qreal ratio) -> QRgb {
+        return premultiplied(KColorUtils::mix(background, foreground, ratio));
+    };
+    auto transparent = [] (const QColor &color) -> QRgb {
+        QColor c(color);
+        c.setAlphaF(0);
+        return qPremultiply(c.rgba());
+    };
+
+    //--- Normal
+    ButtonColors &normal = m_buttonColors[NormalButtonColors];
+    normal.background.normal = transparent(KColorUtils::mix(background, foreground, 0.2));
+    normal.background.hovered = mixed(0.2);
+    normal.background.pressed = mixed(0.3);
+    normal.foreground.normal = mixed(0.8);
+    normal.foreground.hovered = premultiplied(foreground);
+    normal.foreground.pressed = premultiplied(foreground);
+
+    //--- Checked
+    ButtonColors &checked = m_buttonColors[CheckedButtonColors];
+    checked.background.normal = premultiplied(foreground);
+    checked.background.hovered = mixed(0.8);
+    checked.background.pressed = mixed(0.7);
+    checked.foreground.normal = mixed(0.2);
+    checked.foreground.hovered = premultiplied(background);
+    checked.foreground.pressed = premultiplied(background);
+
+    //--- CloseButton
+    ButtonColors &close = m_buttonColors[CloseButtonColors];
+    close.background.normal = transparent(m_colors.warningForeground);
+    close.background.hovered = premultiplied(m_colors.warningForeground);
+    close.background.pressed = premultiplied(m_colors.warningForeground.lighter());
+    close.foreground = normal.foreground;
+}
+
+const Decoration::ButtonColors &Decoration::buttonColors(const Button *button) const
+{
+    if (button->type() == KDecoration2::DecorationButtonType::Close) {
+        return m_buttonColors[CloseButtonColors];
+    }
+    if (button->isChecked() && button->type() != KDecoration2::DecorationButtonType::Maximize) {
+        return m_buttonColors[CheckedButtonColors];
+    }
+    return m_buttonColors[NormalButtonColors];
+}
+
+const Decoration::ButtonColors &Decoration::buttonColors(ButtonColorClass colorClass) const
+{
+    return m_buttonColors[colorClass];
 }
 
 void Decoration::updateBorders()
@@ -558,11 +780,18 @@ void Decoration::updateButtonAnimation()
     m_menuButtons->setAnimationDuration(duration);
 }
 
+void Decoration::updateQuality()
+{
+    updateButtonAnimation();
+    updateShadow();
+    update();
+}
+
 void Decoration::updateShadow()
 {
     const QColor shadowColor = m_internalSettings->shadowColor();
     const int shadowStrengthInt = m_internalSettings->shadowStrength();
-    const int shadowSizePreset = m_internalSettings->shadowSize();
+    const int shadowSizePreset = QualityGovernor::self()->shadowSize(m_internalSettings->shadowSize());
 
     if (!s_cachedShadow.isNull()
         && s_shadowColor == shadowColor
@@ -650,9 +879,15 @@ bool Decoration::menuAlwaysShow() const
     return m_internalSettings->menuAlwaysShow();
 }
 
+int Decoration::menuPrefetch() const
+{
+    return m_internalSettings->menuPrefetch();
+}
+
 bool Decoration::animationsEnabled() const
 {
-    return m_internalSettings->animationsEnabled();
+    return m_internalSettings->animationsEnabled()
+        && QualityGovernor::self()->animationsEnabled();
 }
 
 int Decoration::animationsDuration() const
@@ -938,51 +1173,53 @@ void Decoration::paintFrameBackground(QPainter *painter, const QRect &repaintReg
 
     painter->save();
 
-    painter->fillRect(rect(), Qt::transparent);
-    painter->setRenderHint(QPainter::Antialiasing);
-    painter->setPen(Qt::NoPen);
-    painter->setBrush(borderColor());
-    painter->setClipRect(0, borderTop(), size().width(), size().height() - borderTop(), Qt::IntersectClip);
-    painter->drawRect(rect());
+    if (m_opaque) {
+        // Every pixel below the titlebar is overwritten, so there is
+        // nothing to clear or blend with.
+        painter->setCompositionMode(QPainter::CompositionMode_Source);
+        painter->fillRect(0, borderTop(), size().width(), size().height() - borderTop(), borderColor());
+    } else {
+        painter->fillRect(rect(), Qt::transparent);
+        painter->setRenderHint(QPainter::Antialiasing);
+        painter->setPen(Qt::NoPen);
+        painter->setBrush(borderColor());
+        painter->setClipRect(0, borderTop(), size().width(), size().height() - borderTop(), Qt::IntersectClip);
+        painter->drawRect(rect());
+    }
 
     painter->restore();
 }
 
 QColor Decoration::borderColor() const
 {
-    const auto *decoratedClient = client().toStrongRef().data();
-    const auto group = decoratedClient->isActive()
-        ? KDecoration2::ColorGroup::Active
-        : KDecoration2::ColorGroup::Inactive;
-    const qreal opacity = decoratedClient->isActive()
-        ? m_internalSettings->activeOpacity()
-        : m_internalSettings->inactiveOpacity();
-    QColor color = decoratedClient->color(group, KDecoration2::ColorRole::Frame);
-    color.setAlphaF(opacity);
-    return color;
+#ifdef BENCHMARK
+    ++s_colorReads;
+#endif
+    return m_colors.border;
 }
 
 QColor Decoration::titleBarBackgroundColor() const
 {
-    const auto *decoratedClient = client().toStrongRef().data();
-    const auto group = decoratedClient->isActive()
-        ? KDecoration2::ColorGroup::Active
-        : KDecoration2::ColorGroup::Inactive;
-    const qreal opacity = decoratedClient->isActive()
-        ? m_internalSettings->activeOpacity()
-        : m_internalSettings->inactiveOpacity();
-    QColor color = decoratedClient->color(group, KDecoration2::ColorRole::TitleBar);
-    color.setAlphaF(opacity);
-    return color;
+#ifdef BENCHMARK
+    ++s_colorReads;
+#endif
+    return m_colors.titleBarBackground;
 }
 
 QColor Decoration::titleBarForegroundColor() const
 {
-    const auto *decoratedClient = client().toStrongRef().data();
-    const auto group = decoratedClient->isActive()
-        ? KDecoration2::ColorGroup::Active
-        : KDecoration2::ColorGroup::Inactive;
-    return decoratedClient->color(group, KDecoration2::ColorRole::Foreground);
+#ifdef BENCHMARK
+    ++s_colorReads;
+#endif
+    return m_colors.titleBarForeground;
+}
+
+QColor Decoration::warningForegroundColor() const
+{
+#ifdef BENCHMARK
+    ++s_colorReads;
+#endif
+    return m_colors.warningForeground;
 }
 
 void Decoration::paintTitleBarBackground(QPainter *painter, const QRect &repaintRegion) const
@@ -990,6 +1227,18 @@ void Decoration::paintTitleBarBackground(QPainter *painter, const QRect &repaint
     Q_UNUSED(repaintRegion)
 
     painter->save();
+    if (m_opaque) {
+        // An opaque decoration must cover its whole rect, so the corners
+        // outside the rounded titlebar get the border colour. When shaded,
+        // paintFrameBackground() is skipped, so that includes the bottom ones.
+        const auto *decoratedClient = client().toStrongRef().data();
+        const QRect opaqueRect = decoratedClient->isShaded()
+            ? rect()
+            : QRect(0, 0, size().width(), borderTop());
+        painter->setCompositionMode(QPainter::CompositionMode_Source);
+        painter->fillRect(opaqueRect, borderColor());
+        painter->setCompositionMode(QPainter::CompositionMode_SourceOver);
+    }
     painter->setPen(Qt::NoPen);
     painter->setBrush(titleBarBackgroundColor());
     // painter->drawRect(QRect(0, 0, size().width(), titleBarHeight()));
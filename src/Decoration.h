@@ -32,6 +32,7 @@
 #include <QHoverEvent>
 #include <QMouseEvent>
 #include <QRectF>
+#include <QRegion>
 #include <QSharedPointer>
 #include <QWheelEvent>
 #include <QVariant>
@@ -61,6 +62,11 @@ public:
 
     void paint(QPainter *painter, const QRect &repaintRegion) override;
 
+    // Writes the GTK button assets below configDirectory in one pass, see
+    // ButtonAssetExporter. For kde-gtk-config's kded module to call
+    // through QMetaObject::invokeMethod() instead of painting each button.
+    Q_INVOKABLE bool exportButtonAssets(const QString &configDirectory, const QList<int> &sizes);
+
 public slots:
     void init() override;
     void reconfigure();
@@ -78,7 +84,12 @@ private slots:
 
 private:
     void updateBlur();
+    QRegion blurRegionShape() const;
     void updateBorders();
+    void updateOpaque();
+    void updateColors();
+    void updateColorsForState(bool active);
+    void updateButtonColors();
     void updateResizeBorders();
     void updateTitleBar();
     void updateTitleBarHoverState();
@@ -89,9 +100,11 @@ private:
     void updateButtonsGeometry();
     void setButtonGroupAnimation(KDecoration2::DecorationButtonGroup *buttonGroup, bool enabled, int duration);
     void updateButtonAnimation();
+    void updateQuality();
     void updateShadow();
 
     bool menuAlwaysShow() const;
+    int menuPrefetch() const;
     bool animationsEnabled() const;
     int animationsDuration() const;
     int buttonPadding() const;
@@ -120,6 +133,7 @@ private:
     QColor borderColor() const;
     QColor titleBarBackgroundColor() const;
     QColor titleBarForegroundColor() const;
+    QColor warningForegroundColor() const;
 
     void paintFrameBackground(QPainter *painter, const QRect &repaintRegion) const;
     void paintTitleBarBackground(QPainter *painter, const QRect &repaintRegion) const;
@@ -133,6 +147,50 @@ private:
 
     QSharedPointer<InternalSettings> m_internalSettings;
 
+    // Set when neither the active nor the inactive opacity is below 1, in
+    // which case every pixel is painted opaque, see updateOpaque().
+    bool m_opaque;
+
+    // Palette for the current (active state, client palette, opacity settings).
+    // Rebuilt by updateColors() and read by all of the paint code.
+    struct Colors
+    {
+        QColor border;
+        QColor titleBarBackground;
+        QColor titleBarForeground;
+        QColor warningForeground;
+    };
+    Colors m_colors;
+
+    // Endpoint colours of the button hover/press transitions, computed once
+    // per palette and shared by every button of the decoration. They are
+    // stored premultiplied so an animation frame is a linear interpolation.
+    struct ButtonColorStates
+    {
+        QRgb normal = 0;
+        QRgb hovered = 0;
+        QRgb pressed = 0;
+    };
+    struct ButtonColors
+    {
+        ButtonColorStates background;
+        ButtonColorStates foreground;
+    };
+    enum ButtonColorClass
+    {
+        NormalButtonColors,
+        CheckedButtonColors,
+        CloseButtonColors,
+        ButtonColorClassCount
+    };
+    ButtonColors m_buttonColors[ButtonColorClassCount];
+
+    const ButtonColors &buttonColors(const Button *button) const;
+    const ButtonColors &buttonColors(ButtonColorClass colorClass) const;
+
+    // Last region passed to setBlurRegion().
+    QRegion m_blurRegion;
+
     QPoint m_pressedPoint;
 
 #if HAVE_X11
@@ -141,6 +199,7 @@ private:
 
     friend class AppMenuButtonGroup;
     friend class Button;
+    friend class ButtonAssetExporter;
     friend class AppIconButton;
     friend class AppMenuButton;
     friend class TextButton;
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2020 Chris Holland <zrenfire@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// own
+#include "GlyphAtlas.h"
+#include "Button.h"
+
+// Qt
+#include <QCache>
+#include <QImage>
+#include <QPaintDevice>
+#include <QPair>
+#include <QtMath> // qCeil, qFloor
+
+
+namespace Material
+{
+namespace GlyphAtlas
+{
+
+namespace
+{
+
+// Every window shares the same few glyphs, so a small budget is enough.
+const int s_maxCacheCost = 512 * 1024; // bytes
+
+QCache<quint64, QImage> s_glyphs(s_maxCacheCost);
+
+// The masks tinted with the colours they were drawn with, so painting a
+// glyph is a single blit. Buttons quantize their glyph colour transitions,
+// so hover animations reuse the same few colours.
+const int s_maxTintedCacheCost = 1024 * 1024; // bytes
+
+typedef QPair<quint64, QRgb> TintKey;
+QCache<TintKey, QImage> s_tintedGlyphs(s_maxTintedCacheCost);
+
+quint64 glyphKey(const Button *button, const QRectF &iconRect, qreal dpr,
+                 bool antialiasing, int subpixelX, int subpixelY)
+{
+    quint64 key = static_cast<quint64>(button->type()) & 0xff;
+    key = (key << 1) | (button->isChecked() ? 1 : 0);
+    key = (key << 1) | (antialiasing ? 1 : 0);
+    key = (key << 2) | (subpixelX & 0x3);
+    key = (key << 2) | (subpixelY & 0x3);
+    key = (key << 16) | (qRound(iconRect.width() * 16) & 0xffff);
+    key = (key << 16) | (qRound(dpr * 100) & 0xffff);
+    return key;
+}
+
+QImage tint(const QImage &mask, const QColor &color)
+{
+    QImage tinted(mask.size(), QImage::Format_ARGB32_Premultiplied);
+    tinted.setDevicePixelRatio(mask.devicePixelRatio());
+    tinted.fill(color);
+
+    QPainter tintPainter(&tinted);
+    tintPainter.setCompositionMode(QPainter::CompositionMode_DestinationIn);
+    tintPainter.drawImage(0, 0, mask);
+    tintPainter.end();
+
+    return tinted;
+}
+
+} // anonymous namespace
+
+bool supports(KDecoration2::DecorationButtonType type)
+{
+    switch (type) {
+    case KDecoration2::DecorationButtonType::ApplicationMenu:
+    case KDecoration2::DecorationButtonType::OnAllDesktops:
+    case KDecoration2::DecorationButtonType::ContextHelp:
+    case KDecoration2::DecorationButtonType::Shade:
+    case KDecoration2::DecorationButtonType::KeepAbove:
+    case KDecoration2::DecorationButtonType::KeepBelow:
+    case KDecoration2::DecorationButtonType::Close:
+    case KDecoration2::DecorationButtonType::Maximize:
+    case KDecoration2::DecorationButtonType::Minimize:
+        return true;
+
+    // The Menu button draws the window icon, and Custom buttons
+    // (the AppMenu) draw text.
+    default:
+        return false;
+    }
+}
+
+void paint(Button *button, QPainter *painter, const QRectF &iconRect,
+           qreal gridUnit, const QColor &color)
+{
+    // Masks are aligned to the device pixel grid, which only holds when
+    // the painter is not scaled or rotated (eg: in the KCM preview).
+    if (painter->transform().type() > QTransform::TxTranslate) {
+        button->paintIconForType(painter, iconRect, gridUnit);
+        return;
+    }
+
+    const qreal dpr = painter->device()->devicePixelRatioF();
+    const bool antialiasing = painter->testRenderHint(QPainter::Antialiasing);
+
+    // Strokes are centered on the icon outline, so leave room for half the
+    // widest pen (1.25x) on every side.
+    const int padding = qCeil(button->iconLineWidth(gridUnit) * 1.25) + 1;
+
+    // Keep the subpixel position of the icon, quantized to quarter pixels,
+    // so the antialiasing matches the directly painted icon.
+    const int quarterX = qRound(iconRect.x() * 4);
+    const int quarterY = qRound(iconRect.y() * 4);
+    const QPointF origin(qFloor(quarterX / 4.0), qFloor(quarterY / 4.0));
+    const int subpixelX = quarterX - qRound(origin.x()) * 4;
+    const int subpixelY = quarterY - qRound(origin.y()) * 4;
+
+    const quint64 key = glyphKey(button, iconRect, dpr, antialiasing, subpixelX, subpixelY);
+    const QImage *mask = s_glyphs.object(key);
+
+    if (!mask) {
+        const QSize size(
+            qCeil(iconRect.width()) + 1 + padding * 2,
+            qCeil(iconRect.height()) + 1 + padding * 2
+        );
+        QImage glyph(size * dpr, QImage::Format_ARGB32_Premultiplied);
+        glyph.setDevicePixelRatio(dpr);
+        glyph.fill(Qt::transparent);
+
+        QRectF glyphRect(iconRect);
+        glyphRect.moveTopLeft(QPointF(
+            padding + subpixelX / 4.0,
+            padding + subpixelY / 4.0
+        ));
+
+        QPainter glyphPainter(&glyph);
+        glyphPainter.setRenderHints(QPainter::Antialiasing, antialiasing);
+        glyphPainter.setPen(Qt::white);
+        button->setPenWidth(&glyphPainter, gridUnit, 1);
+        glyphPainter.setBrush(Qt::NoBrush);
+        button->paintIconForType(&glyphPainter, glyphRect, gridUnit);
+        glyphPainter.end();
+
+        QImage *alphaMask = new QImage(glyph.convertToFormat(QImage::Format_Alpha8));
+        alphaMask->setDevicePixelRatio(dpr);
+        mask = alphaMask;
+        if (!s_glyphs.insert(key, alphaMask, alphaMask->sizeInBytes())) {
+            // Larger than the whole cache, QCache already deleted it.
+            button->paintIconForType(painter, iconRect, gridUnit);
+            return;
+        }
+    }
+
+    const QPointF topLeft = origin - QPointF(padding, padding);
+    const TintKey tintKey(key, color.rgba());
+    const QImage *tinted = s_tintedGlyphs.object(tintKey);
+
+    if (!tinted) {
+        const QImage image = tint(*mask, color);
+        if (!s_tintedGlyphs.insert(tintKey, new QImage(image), image.sizeInBytes())) {
+            // Larger than the whole cache, QCache already deleted the copy.
+            painter->drawImage(topLeft, image);
+            return;
+        }
+        tinted = s_tintedGlyphs.object(tintKey);
+    }
+
+    painter->drawImage(topLeft, *tinted);
+}
+
+} // namespace GlyphAtlas
+} // namespace Material
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2020 Chris Holland <zrenfire@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// KDecoration
+#include <KDecoration2/DecorationButton>
+
+// Qt
+#include <QColor>
+#include <QPainter>
+#include <QRectF>
+
+namespace Material
+{
+
+class Button;
+
+// Process-wide cache of the titlebar button icons. Each icon is rasterized
+// once per (type, checked state, size, device pixel ratio) as an alpha mask,
+// and tinted once per foreground colour, so painting one is a single blit.
+namespace GlyphAtlas
+{
+
+bool supports(KDecoration2::DecorationButtonType type);
+
+void paint(Button *button, QPainter *painter, const QRectF &iconRect,
+           qreal gridUnit, const QColor &color);
+
+} // namespace GlyphAtlas
+} // namespace Material
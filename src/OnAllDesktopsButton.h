@@ -41,7 +41,6 @@ public:
     }
     static void paintIcon(Button *button, QPainter *painter, const QRectF &iconRect, const qreal gridUnit) {
         Q_UNUSED(gridUnit)
-        painter->setRenderHints(QPainter::Antialiasing, true);
         button->setPenWidth(painter, gridUnit, 1.25);
 
         int radius = qMin(iconRect.width(), iconRect.height()) / 2;
@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2020 Chris Holland <zrenfire@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// own
+#include "QualityGovernor.h"
+#include "Material.h"
+#include "InternalSettings.h"
+
+// Qt
+#include <QDebug>
+
+
+namespace Material
+{
+
+static QualityGovernor *s_self = nullptr;
+
+// Weight of a new sample in the moving average.
+static const qreal s_smoothing = 0.125;
+// Consecutive paints needed before dropping or raising the level.
+static const int s_degradeRun = 8;
+static const int s_restoreRun = 120;
+// Log the statistics every so many paints.
+static const int s_statsInterval = 1000;
+
+QualityGovernor *QualityGovernor::self()
+{
+    if (!s_self) {
+        s_self = new QualityGovernor();
+    }
+    return s_self;
+}
+
+void QualityGovernor::release()
+{
+    delete s_self;
+    s_self = nullptr;
+}
+
+QualityGovernor::QualityGovernor()
+    : QObject()
+    , m_enabled(false)
+    , m_budget(0)
+    , m_level(FullQuality)
+    , m_average(0)
+    , m_overBudgetRun(0)
+    , m_underBudgetRun(0)
+    , m_paintCount(0)
+    , m_overBudgetCount(0)
+    , m_maxPaintTime(0)
+    , m_degradeCount(0)
+    , m_restoreCount(0)
+{
+}
+
+void QualityGovernor::configure(bool enabled, int paintBudget)
+{
+    const qint64 budget = static_cast<qint64>(paintBudget) * 1000;
+    if (m_enabled == enabled && m_budget == budget) {
+        return;
+    }
+
+    qCDebug(category) << "QualityGovernor::configure" << "enabled:" << enabled << "budget:" << paintBudget << "us";
+
+    m_enabled = enabled;
+    m_budget = budget;
+    m_average = 0;
+    m_overBudgetRun = 0;
+    m_underBudgetRun = 0;
+
+    if (!m_enabled) {
+        setLevel(FullQuality);
+    }
+}
+
+bool QualityGovernor::isEnabled() const
+{
+    return m_enabled;
+}
+
+QualityGovernor::Level QualityGovernor::level() const
+{
+    return m_level;
+}
+
+bool QualityGovernor::animationsEnabled() const
+{
+    return m_level == FullQuality;
+}
+
+bool QualityGovernor::glyphAntialiasing() const
+{
+    return m_level == FullQuality;
+}
+
+int QualityGovernor::shadowSize(int shadowSize) const
+{
+    if (m_level == MinimalQuality) {
+        return qMin(shadowSize, static_cast<int>(InternalSettings::ShadowSmall));
+    }
+    return shadowSize;
+}
+
+void QualityGovernor::addPaintTime(qint64 nsecs)
+{
+    if (!m_enabled) {
+        return;
+    }
+
+    m_paintCount++;
+    m_maxPaintTime = qMax(m_maxPaintTime, nsecs);
+    if (nsecs > m_budget) {
+        m_overBudgetCount++;
+    }
+
+    if (m_average == 0) {
+        m_average = nsecs;
+    } else {
+        m_average += (nsecs - m_average) * s_smoothing;
+    }
+
+    if (m_average > m_budget) {
+        m_underBudgetRun = 0;
+        if (++m_overBudgetRun >= s_degradeRun && m_level != MinimalQuality) {
+            m_overBudgetRun = 0;
+            m_degradeCount++;
+            setLevel(static_cast<Level>(m_level + 1));
+        }
+    } else if (m_average < m_budget / 2) {
+        m_overBudgetRun = 0;
+        if (++m_underBudgetRun >= s_restoreRun && m_level != FullQuality) {
+            m_underBudgetRun = 0;
+            m_restoreCount++;
+            setLevel(static_cast<Level>(m_level - 1));
+        }
+    } else {
+        m_overBudgetRun = 0;
+        m_underBudgetRun = 0;
+    }
+
+    if (m_paintCount % s_statsInterval == 0) {
+        logStats();
+    }
+}
+
+void QualityGovernor::setLevel(Level level)
+{
+    if (m_level == level) {
+        return;
+    }
+    m_level = level;
+    logStats();
+    emit levelChanged(level);
+}
+
+void QualityGovernor::logStats() const
+{
+    qCInfo(category) << "QualityGovernor" << m_level
+        << "average:" << qRound64(m_average / 1000) << "us"
+        << "budget:" << m_budget / 1000 << "us"
+        << "max:" << m_maxPaintTime / 1000 << "us"
+        << "paints:" << m_paintCount
+        << "over budget:" << m_overBudgetCount
+        << "degraded:" << m_degradeCount
+        << "restored:" << m_restoreCount;
+}
+
+} // namespace Material
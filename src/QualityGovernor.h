@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2020 Chris Holland <zrenfire@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Qt
+#include <QObject>
+
+namespace Material
+{
+
+// Measures how long Decoration::paint() takes and lowers the rendering
+// quality of every decoration while paints go over the configured budget.
+//
+// The paint time is smoothed with an exponential moving average. The level
+// drops one step after the average stays over budget for a few paints, and
+// is raised one step only after it stays under half the budget for a much
+// longer run, so the decoration does not flip back and forth at the budget.
+class QualityGovernor : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Level {
+        FullQuality,
+        // No hover animations or caption fades, no antialiasing on button glyphs.
+        ReducedQuality,
+        // Also caps the shadow to the small preset.
+        MinimalQuality,
+    };
+    Q_ENUM(Level)
+
+    // Shared by all decorations, created on first use.
+    static QualityGovernor *self();
+    // Called when the last decoration is destroyed.
+    static void release();
+
+    void configure(bool enabled, int paintBudget);
+    bool isEnabled() const;
+
+    Level level() const;
+    bool animationsEnabled() const;
+    bool glyphAntialiasing() const;
+    int shadowSize(int shadowSize) const;
+
+    void addPaintTime(qint64 nsecs);
+
+signals:
+    void levelChanged(Level level);
+
+private:
+    QualityGovernor();
+
+    void setLevel(Level level);
+    void logStats() const;
+
+    bool m_enabled;
+    qint64 m_budget; // nsecs
+    Level m_level;
+    qreal m_average; // nsecs
+    int m_overBudgetRun;
+    int m_underBudgetRun;
+
+    // Trigger statistics, logged on every level change.
+    quint64 m_paintCount;
+    quint64 m_overBudgetCount;
+    qint64 m_maxPaintTime;
+    int m_degradeCount;
+    int m_restoreCount;
+};
+
+} // namespace Material
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2020 Chris Holland <zrenfire@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// own
+#include "ThemedIconCache.h"
+#include "Material.h"
+
+// KF
+#include <KIconLoader>
+
+// Qt
+#include <QDebug>
+
+
+namespace Material
+{
+
+static ThemedIconCache *s_self = nullptr;
+
+// Number of icons, a few menu bars' worth.
+static const int s_cacheSize = 512;
+// Log the hit rate every so many lookups.
+static const int s_statsInterval = 1000;
+
+ThemedIconCache *ThemedIconCache::self()
+{
+    if (!s_self) {
+        s_self = new ThemedIconCache();
+    }
+    return s_self;
+}
+
+void ThemedIconCache::release()
+{
+    delete s_self;
+    s_self = nullptr;
+}
+
+ThemedIconCache::ThemedIconCache()
+    : QObject()
+    , m_icons(s_cacheSize)
+    , m_themeName(QIcon::themeName())
+    , m_hits(0)
+    , m_misses(0)
+{
+    connect(KIconLoader::global(), &KIconLoader::iconLoaderSettingsChanged,
+        this, &ThemedIconCache::clear);
+}
+
+ThemedIconCache::~ThemedIconCache()
+{
+    logStats();
+}
+
+QIcon ThemedIconCache::icon(const QString &name)
+{
+    checkTheme();
+    return *lookup(name);
+}
+
+void ThemedIconCache::prepare(const QStringList &names)
+{
+    checkTheme();
+
+    // Names that were prepared but never shown, eg: in hidden items
+    if (m_prepared.size() > s_cacheSize) {
+        m_prepared.clear();
+    }
+
+    for (const QString &name : names) {
+        if (!name.isEmpty() && !m_icons.contains(name)) {
+            m_icons.insert(name, new QIcon(QIcon::fromTheme(name)));
+            m_prepared.insert(name);
+        }
+    }
+}
+
+void ThemedIconCache::clear()
+{
+    qCDebug(category) << "ThemedIconCache::clear" << m_icons.count() << "icons";
+
+    m_icons.clear();
+    m_prepared.clear();
+    m_themeName = QIcon::themeName();
+}
+
+void ThemedIconCache::logStats() const
+{
+    qCDebug(category) << "ThemedIconCache" << "hits:" << m_hits << "misses:" << m_misses
+        << "icons:" << m_icons.count();
+}
+
+void ThemedIconCache::checkTheme()
+{
+    if (QIcon::themeName() != m_themeName) {
+        clear();
+    }
+}
+
+QIcon *ThemedIconCache::lookup(const QString &name)
+{
+    QIcon *icon = m_icons.object(name);
+    // The first use of an icon that prepare() resolved is its miss.
+    const bool prepared = m_prepared.remove(name);
+    if (icon && !prepared) {
+        m_hits++;
+    } else {
+        m_misses++;
+        if (!icon) {
+            icon = new QIcon(QIcon::fromTheme(name));
+            m_icons.insert(name, icon);
+        }
+    }
+
+    if ((m_hits + m_misses) % s_statsInterval == 0) {
+        logStats();
+    }
+
+    return icon;
+}
+
+} // namespace Material
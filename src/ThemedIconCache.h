@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2020 Chris Holland <zrenfire@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Qt
+#include <QCache>
+#include <QIcon>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+
+namespace Material
+{
+
+// QIcon::fromTheme() results for app menu items, shared by every window's
+// menu importer. Entries are evicted least recently used first, and all of
+// them are dropped when the icon theme changes.
+class ThemedIconCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Shared by all decorations, created on first use.
+    static ThemedIconCache *self();
+    // Called when the last decoration is destroyed.
+    static void release();
+
+    QIcon icon(const QString &name);
+
+    // Resolves the icons a menu is about to use in one go. This does not
+    // count as a hit or miss, the first icon() call for a name it resolved
+    // counts as the miss.
+    void prepare(const QStringList &names);
+
+    void clear();
+
+private:
+    ThemedIconCache();
+    ~ThemedIconCache() override;
+
+    void logStats() const;
+
+    // Drops the cache if the theme changed since it was filled.
+    void checkTheme();
+    QIcon *lookup(const QString &name);
+
+    QCache<QString, QIcon> m_icons;
+    // Names resolved by prepare() and not looked up since
+    QSet<QString> m_prepared;
+    QString m_themeName;
+    int m_hits;
+    int m_misses;
+};
+
+} // namespace Material
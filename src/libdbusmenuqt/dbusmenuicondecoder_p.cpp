@@ -0,0 +1,127 @@
+/* This file is part of the dbusmenu-qt library
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License (LGPL) as published by the Free Software Foundation;
+   either version 2 of the License, or (at your option) any later
+   version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+#include "dbusmenuicondecoder_p.h"
+
+// Qt
+#include <QCryptographicHash>
+#include <QRunnable>
+
+// In KiB
+static const int s_cacheSize = 4 * 1024;
+
+static const int s_maxThreads = 2;
+
+static DBusMenuIconDecoder *s_self = nullptr;
+static int s_refCount = 0;
+
+class IconDataDecodeJob : public QRunnable
+{
+public:
+    IconDataDecodeJob(DBusMenuIconDecoder *decoder, const QByteArray &digest, const QByteArray &data)
+        : m_decoder(decoder)
+        , m_digest(digest)
+        , m_data(data)
+    {
+    }
+
+    void run() override
+    {
+        QImage image;
+        image.loadFromData(m_data);
+
+        // The decoder waits for its jobs before it is deleted
+        const QByteArray digest = m_digest;
+        DBusMenuIconDecoder *decoder = m_decoder;
+        QMetaObject::invokeMethod(
+            decoder,
+            [decoder, digest, image]() {
+                decoder->insert(digest, image);
+            },
+            Qt::QueuedConnection);
+    }
+
+private:
+    DBusMenuIconDecoder *m_decoder;
+    QByteArray m_digest;
+    QByteArray m_data;
+};
+
+DBusMenuIconDecoder *DBusMenuIconDecoder::acquire()
+{
+    if (s_refCount++ == 0) {
+        s_self = new DBusMenuIconDecoder();
+    }
+    return s_self;
+}
+
+void DBusMenuIconDecoder::release()
+{
+    if (--s_refCount == 0) {
+        delete s_self;
+        s_self = nullptr;
+    }
+}
+
+QByteArray DBusMenuIconDecoder::digest(const QByteArray &data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+}
+
+DBusMenuIconDecoder::DBusMenuIconDecoder()
+    : QObject()
+    , m_cache(s_cacheSize)
+{
+    m_pool.setMaxThreadCount(s_maxThreads);
+}
+
+DBusMenuIconDecoder::~DBusMenuIconDecoder()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+bool DBusMenuIconDecoder::find(const QByteArray &digest, QImage *image) const
+{
+    const QImage *cached = m_cache.object(digest);
+    if (!cached) {
+        return false;
+    }
+    *image = *cached;
+    return true;
+}
+
+void DBusMenuIconDecoder::decode(const QByteArray &digest, const QByteArray &data)
+{
+    if (m_decoding.contains(digest)) {
+        return;
+    }
+    m_decoding.insert(digest);
+    m_pool.start(new IconDataDecodeJob(this, digest, data));
+}
+
+void DBusMenuIconDecoder::insert(const QByteArray &digest, const QImage &image)
+{
+    m_decoding.remove(digest);
+
+    // Failures are cached too, so broken data is not decoded again
+    const int cost = qMax(1, static_cast<int>(image.sizeInBytes() / 1024));
+    m_cache.insert(digest, new QImage(image), cost);
+
+    Q_EMIT decoded(digest, image);
+}
@@ -0,0 +1,77 @@
+/* This file is part of the dbusmenu-qt library
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License (LGPL) as published by the Free Software Foundation;
+   either version 2 of the License, or (at your option) any later
+   version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+#ifndef DBUSMENUICONDECODER_P_H
+#define DBUSMENUICONDECODER_P_H
+
+// Qt
+#include <QCache>
+#include <QImage>
+#include <QObject>
+#include <QSet>
+#include <QThreadPool>
+
+/**
+ * Decodes icon-data properties on worker threads, so large or numerous
+ * icons do not block the GUI thread, and caches the results for all
+ * importers of the process.
+ *
+ * Icons are keyed by a SHA-256 digest of their data, see digest(), so icons
+ * with different data never share an entry. Only use it from the GUI thread.
+ */
+class DBusMenuIconDecoder : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Returns the shared decoder, call release() once done with it
+     */
+    static DBusMenuIconDecoder *acquire();
+    static void release();
+
+    static QByteArray digest(const QByteArray &data);
+
+    /**
+     * Looks up an already decoded icon. @p image is null if its data could
+     * not be decoded.
+     */
+    bool find(const QByteArray &digest, QImage *image) const;
+
+    /**
+     * Decodes @p data unless it is already being decoded. Emits decoded()
+     * when done.
+     */
+    void decode(const QByteArray &digest, const QByteArray &data);
+
+Q_SIGNALS:
+    void decoded(const QByteArray &digest, const QImage &image);
+
+private:
+    DBusMenuIconDecoder();
+    ~DBusMenuIconDecoder() override;
+
+    friend class IconDataDecodeJob;
+    void insert(const QByteArray &digest, const QImage &image);
+
+    QThreadPool m_pool;
+    QCache<QByteArray, QImage> m_cache;
+    QSet<QByteArray> m_decoding;
+};
+
+#endif /* DBUSMENUICONDECODER_P_H */
@@ -29,16 +29,23 @@
 #include <QDBusReply>
 #include <QDBusVariant>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QFont>
+#include <QHash>
 #include <QMenu>
 #include <QPointer>
 #include <QSet>
-#include <QTime>
+#include <QSharedPointer>
 #include <QTimer>
 #include <QToolButton>
+#include <QVector>
 #include <QWidgetAction>
 
+// std
+#include <algorithm>
+
 // Local
+#include "dbusmenuicondecoder_p.h"
 #include "dbusmenushortcut_p.h"
 #include "dbusmenutypes_p.h"
 #include "utils_p.h"
@@ -48,7 +55,8 @@
 
 //#define BENCHMARK
 #ifdef BENCHMARK
-static QTime sChrono;
+static QElapsedTimer sChrono;
+static const char *DBUSMENU_PROPERTY_BENCHMARK_START = "_dbusmenu_benchmark_start";
 #endif
 
 #define DMRETURN_IF_FAIL(cond)                                                                                                                                 \
@@ -57,9 +65,18 @@ static QTime sChrono;
         return;                                                                                                                                                \
     }
 
-static const char *DBUSMENU_PROPERTY_ID = "_dbusmenu_id";
-static const char *DBUSMENU_PROPERTY_ICON_NAME = "_dbusmenu_icon_name";
-static const char *DBUSMENU_PROPERTY_ICON_DATA_HASH = "_dbusmenu_icon_data_hash";
+// Layout updates are refreshed right away, then with a delay that doubles
+// while they keep coming, up to s_maxLayoutUpdateDelay. Once there were none
+// for s_layoutUpdateQuietPeriod the next one is immediate again.
+static const int s_minLayoutUpdateDelay = 16;
+static const int s_maxLayoutUpdateDelay = 1000;
+static const int s_layoutUpdateQuietPeriod = 2 * s_maxLayoutUpdateDelay;
+
+// Property updates are applied at most once per frame
+static const int s_propertyUpdateInterval = 16;
+
+// How long a submenu stays hidden before its actions are released
+static const int s_menuReleaseDelay = 2 * 60 * 1000;
 
 static QAction *createKdeTitle(QAction *action, QWidget *parent)
 {
@@ -84,23 +101,220 @@ public:
 
     DBusMenuInterface *m_interface;
     QMenu *m_menu;
-    using ActionForId = QMap<int, QAction *>;
+    using ActionForId = QHash<int, QAction *>;
     ActionForId m_actionForId;
+
+    // What we know about each imported action, kept here rather than in
+    // QObject dynamic properties to avoid their linear lookup and boxing.
+    struct ActionInfo {
+        int id = 0;
+        QString iconName;
+        QByteArray iconDataDigest;
+    };
+    QHash<QAction *, ActionInfo> m_actionInfo;
+
+    DBusMenuIconDecoder *m_iconDecoder;
+    // Actions waiting for their icon-data to be decoded
+    QHash<QByteArray, QVector<QPointer<QAction>>> m_pendingIconData;
+
+    // Menu id each pending GetLayout or AboutToShow call was made for
+    QHash<QDBusPendingCallWatcher *, int> m_watcherIds;
+
+    // Submenus whose children came with a GetLayout() reply but have not been
+    // shown yet. Their items stay in the reply's flat arrays and only become
+    // actions when the submenu is about to be shown.
+    struct DeferredMenu {
+        QSharedPointer<const DBusMenuLayout> layout;
+        int node;
+    };
+    QHash<int, DeferredMenu> m_deferredMenus;
+    // Item id -> id of the deferred menu holding it
+    QHash<int, int> m_deferredItems;
+    // Property updates for deferred items, applied when they become actions
+    QHash<int, DBusMenuProperties> m_deferredOverrides;
+    // Submenus in a deferred menu whose layout changed. They are fetched on
+    // their own when shown instead of being built from the deferred menu.
+    QSet<int> m_staleDeferredMenus;
+
+    // Hidden submenus and when they were hidden, to release their actions
+    // once they have not been used for s_menuReleaseDelay.
+    QHash<QMenu *, qint64> m_hiddenMenus;
+    QElapsedTimer m_hiddenClock;
+    QTimer *m_menuReleaseTimer;
     QTimer *m_pendingLayoutUpdateTimer;
 
+    // Latest GetLayout() call per menu id, replies to older ones are dropped
+    QHash<int, QDBusPendingCallWatcher *> m_layoutCalls;
+    // Revision of the last layout applied per menu id
+    QHash<int, uint> m_layoutRevisions;
+    // Some exporters always send the same revision, which then says nothing
+    // about the layout. Revisions are only trusted once they changed.
+    bool m_hasRevision = false;
+    bool m_revisionsChange = false;
+    uint m_firstRevision = 0;
+    // Redundant refreshes and replies avoided, for debugging
+    int m_skippedRefreshes = 0;
+    int m_droppedReplies = 0;
+
+    // Property updates not applied yet, by item id
+    QHash<int, DBusMenuProperties> m_pendingPropertyUpdates;
+    QTimer *m_propertyUpdateTimer;
+
+    DBusMenuImporter::ImportMode m_importMode;
+
     QSet<int> m_idsRefreshedByAboutToShow;
     QSet<int> m_pendingLayoutUpdates;
+    int m_layoutUpdateDelay = 0;
+    QElapsedTimer m_lastLayoutUpdate;
 
     QDBusPendingCallWatcher *refresh(int id)
     {
-        auto call = m_interface->GetLayout(id, 1, QStringList());
+        const int recursionDepth = m_importMode == DBusMenuImporter::ImportFullTree ? -1 : 1;
+        auto call = m_interface->GetLayout(id, recursionDepth, QStringList());
         QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, q);
-        watcher->setProperty(DBUSMENU_PROPERTY_ID, id);
+        m_watcherIds.insert(watcher, id);
+        // Supersedes any call for the same menu still in flight
+        m_layoutCalls.insert(id, watcher);
         QObject::connect(watcher, &QDBusPendingCallWatcher::finished, q, &DBusMenuImporter::slotGetLayoutFinished);
 
+#ifdef BENCHMARK
+        if (!sChrono.isValid()) {
+            sChrono.start();
+        }
+        watcher->setProperty(DBUSMENU_PROPERTY_BENCHMARK_START, sChrono.elapsed());
+#endif
+
         return watcher;
     }
 
+    /**
+     * Returns the dbusmenu id of @p action, 0 (the root) for actions we did not create
+     */
+    int idForAction(QAction *action) const
+    {
+        return m_actionInfo.value(action).id;
+    }
+
+    void scheduleLayoutUpdates()
+    {
+        if (m_pendingLayoutUpdateTimer->isActive()) {
+            return;
+        }
+        if (!m_lastLayoutUpdate.isValid() || m_lastLayoutUpdate.elapsed() > s_layoutUpdateQuietPeriod) {
+            m_layoutUpdateDelay = 0;
+        } else {
+            m_layoutUpdateDelay = qBound(s_minLayoutUpdateDelay, m_layoutUpdateDelay * 2, s_maxLayoutUpdateDelay);
+        }
+        m_pendingLayoutUpdateTimer->start(m_layoutUpdateDelay);
+    }
+
+    /**
+     * Returns the id of the menu holding item @p id, or -1 if unknown
+     */
+    int parentMenuId(int id) const
+    {
+        QAction *action = m_actionForId.value(id);
+        QMenu *menu = action ? qobject_cast<QMenu *>(action->parent()) : nullptr;
+        if (!menu) {
+            return -1;
+        }
+        if (menu == m_menu) {
+            return 0;
+        }
+        auto it = m_actionInfo.constFind(menu->menuAction());
+        return it != m_actionInfo.constEnd() ? it->id : -1;
+    }
+
+    /**
+     * Whether a menu containing @p id, directly or not, is in @p ids
+     */
+    bool hasAncestorIn(int id, const QSet<int> &ids) const
+    {
+        for (int parentId = parentMenuId(id); parentId >= 0; parentId = parentMenuId(parentId)) {
+            if (ids.contains(parentId)) {
+                return true;
+            }
+            if (parentId == 0) {
+                break;
+            }
+        }
+        return false;
+    }
+
+    void noteRevision(uint revision)
+    {
+        if (!m_hasRevision) {
+            m_hasRevision = true;
+            m_firstRevision = revision;
+        } else if (revision != m_firstRevision) {
+            m_revisionsChange = true;
+        }
+    }
+
+    /**
+     * Whether the layout applied for menu @p id already includes @p revision
+     */
+    bool hasRevision(int id, uint revision) const
+    {
+        auto it = m_layoutRevisions.constFind(id);
+        return m_revisionsChange && it != m_layoutRevisions.constEnd() && revision <= *it;
+    }
+
+    int applyLayout(QMenu *menu, const QSharedPointer<const DBusMenuLayout> &layout, int parentNode);
+
+    void deferMenu(int id, const QSharedPointer<const DBusMenuLayout> &layout, int node)
+    {
+        discardDeferredMenu(id);
+        m_deferredMenus.insert(id, DeferredMenu{layout, node});
+        const int end = layout->nodes.at(node).subtreeEnd;
+        for (int i = node + 1; i < end; ++i) {
+            m_deferredItems.insert(layout->nodes.at(i).id, id);
+        }
+    }
+
+    void discardDeferredMenu(int id)
+    {
+        const DeferredMenu deferred = m_deferredMenus.take(id);
+        if (!deferred.layout) {
+            return;
+        }
+        const int end = deferred.layout->nodes.at(deferred.node).subtreeEnd;
+        for (int i = deferred.node + 1; i < end; ++i) {
+            auto it = m_deferredItems.find(deferred.layout->nodes.at(i).id);
+            if (it != m_deferredItems.end() && *it == id) {
+                m_deferredItems.erase(it);
+            }
+        }
+    }
+
+    /**
+     * Forgets what is known about the deferred items in @p layout, which
+     * is newer.
+     */
+    void forgetDeferredItems(const DBusMenuLayout &layout)
+    {
+        if (m_deferredOverrides.isEmpty() && m_staleDeferredMenus.isEmpty()) {
+            return;
+        }
+        for (const DBusMenuLayoutNode &node : layout.nodes) {
+            m_deferredOverrides.remove(node.id);
+            m_staleDeferredMenus.remove(node.id);
+        }
+    }
+
+    void materializeMenu(QMenu *menu, int id)
+    {
+        const DeferredMenu deferred = m_deferredMenus.value(id);
+        if (!deferred.layout) {
+            return;
+        }
+        discardDeferredMenu(id);
+        applyLayout(menu, deferred.layout, deferred.node);
+    }
+
+    void releaseUnusedMenus();
+    void reorderActions(QMenu *menu, const QVector<QAction *> &orderedActions);
+
     QMenu *createMenu(QWidget *parent)
     {
         QMenu *menu = q->createMenu(parent);
@@ -111,27 +325,40 @@ public:
      * Init all the immutable action properties here
      * TODO: Document immutable properties?
      *
-     * Note: we remove properties we handle from the map (using QMap::take()
-     * instead of QMap::value()) to avoid warnings about these properties in
-     * updateAction()
+     * Immutable properties are skipped by updateAction(), so the same
+     * property list can be passed on for the mutable ones.
      */
-    QAction *createAction(int id, const QVariantMap &_map, QWidget *parent)
+    QAction *createAction(int id, DBusMenuPropertySpan properties, QWidget *parent)
     {
-        QVariantMap map = _map;
         QAction *action = new QAction(parent);
-        action->setProperty(DBUSMENU_PROPERTY_ID, id);
-
-        QString type = map.take(QStringLiteral("type")).toString();
-        if (type == QLatin1String("separator")) {
-            action->setSeparator(true);
-        }
-
-        if (map.take(QStringLiteral("children-display")).toString() == QLatin1String("submenu")) {
-            QMenu *menu = createMenu(parent);
-            action->setMenu(menu);
+        m_actionInfo[action].id = id;
+
+        QString toggleType;
+        bool isKdeTitle = false;
+        for (const DBusMenuPropertyValue &property : properties) {
+            switch (property.key) {
+            case DBusMenuProperty::Type:
+                if (property.value.toString() == QLatin1String("separator")) {
+                    action->setSeparator(true);
+                }
+                break;
+            case DBusMenuProperty::ChildrenDisplay:
+                if (property.value.toString() == QLatin1String("submenu")) {
+                    QMenu *menu = createMenu(parent);
+                    action->setMenu(menu);
+                }
+                break;
+            case DBusMenuProperty::ToggleType:
+                toggleType = property.value.toString();
+                break;
+            case DBusMenuProperty::KdeTitle:
+                isKdeTitle = property.value.toBool();
+                break;
+            default:
+                break;
+            }
         }
 
-        QString toggleType = map.take(QStringLiteral("toggle-type")).toString();
         if (!toggleType.isEmpty()) {
             action->setCheckable(true);
             if (toggleType == QLatin1String("radio")) {
@@ -140,79 +367,106 @@ public:
             }
         }
 
-        bool isKdeTitle = map.take(QStringLiteral("x-kde-title")).toBool();
-        updateAction(action, map, map.keys());
+        // toggle-state must be applied after setCheckable()
+        updateAction(action, properties);
 
         if (isKdeTitle) {
-            action = createKdeTitle(action, parent);
+            QAction *titleAction = createKdeTitle(action, parent);
+            m_actionInfo.insert(titleAction, m_actionInfo.take(action));
+            action = titleAction;
         }
 
         return action;
     }
 
     /**
-     * Update mutable properties of an action. A property may be listed in
-     * requestedProperties but not in map, this means we should use the default value
-     * for this property.
+     * Update the mutable properties of an action. Immutable properties are
+     * ignored.
      *
      * @param action the action to update
-     * @param map holds the property values
-     * @param requestedProperties which properties has been requested
+     * @param properties holds the property values
      */
-    void updateAction(QAction *action, const QVariantMap &map, const QStringList &requestedProperties)
+    void updateAction(QAction *action, DBusMenuPropertySpan properties)
     {
-        Q_FOREACH (const QString &key, requestedProperties) {
-            updateActionProperty(action, key, map.value(key));
+        for (const DBusMenuPropertyValue &property : properties) {
+            updateActionProperty(action, property.key, property.name, property.value);
         }
     }
 
-    void updateActionProperty(QAction *action, const QString &key, const QVariant &value)
+    /**
+     * Update a single property. An invalid @p value means the property was
+     * removed and its default value should be used.
+     */
+    void updateActionProperty(QAction *action, DBusMenuProperty key, const QString &name, const QVariant &value)
     {
-        if (key == QLatin1String("label")) {
+        switch (key) {
+        case DBusMenuProperty::Label:
             updateActionLabel(action, value);
-        } else if (key == QLatin1String("enabled")) {
+            break;
+        case DBusMenuProperty::Enabled:
             updateActionEnabled(action, value);
-        } else if (key == QLatin1String("toggle-state")) {
+            break;
+        case DBusMenuProperty::ToggleState:
             updateActionChecked(action, value);
-        } else if (key == QLatin1String("icon-name")) {
+            break;
+        case DBusMenuProperty::IconName:
             updateActionIconByName(action, value);
-        } else if (key == QLatin1String("icon-data")) {
+            break;
+        case DBusMenuProperty::IconData:
             updateActionIconByData(action, value);
-        } else if (key == QLatin1String("visible")) {
+            break;
+        case DBusMenuProperty::Visible:
             updateActionVisible(action, value);
-        } else if (key == QLatin1String("shortcut")) {
+            break;
+        case DBusMenuProperty::Shortcut:
             updateActionShortcut(action, value);
-        } else {
-            qDebug(DBUSMENUQT) << "Unhandled property update" << key;
+            break;
+        case DBusMenuProperty::Type:
+        case DBusMenuProperty::ToggleType:
+        case DBusMenuProperty::ChildrenDisplay:
+        case DBusMenuProperty::KdeTitle:
+            // Immutable, handled in createAction()
+            break;
+        case DBusMenuProperty::Unknown:
+            qDebug(DBUSMENUQT) << "Unhandled property update" << name;
+            break;
         }
     }
 
     void updateActionLabel(QAction *action, const QVariant &value)
     {
         QString text = swapMnemonicChar(value.toString(), '_', '&');
-        action->setText(text);
+        if (action->text() != text) {
+            action->setText(text);
+        }
     }
 
     void updateActionEnabled(QAction *action, const QVariant &value)
     {
-        action->setEnabled(value.isValid() ? value.toBool() : true);
+        const bool enabled = value.isValid() ? value.toBool() : true;
+        if (action->isEnabled() != enabled) {
+            action->setEnabled(enabled);
+        }
     }
 
     void updateActionChecked(QAction *action, const QVariant &value)
     {
         if (action->isCheckable() && value.isValid()) {
-            action->setChecked(value.toInt() == 1);
+            const bool checked = value.toInt() == 1;
+            if (action->isChecked() != checked) {
+                action->setChecked(checked);
+            }
         }
     }
 
     void updateActionIconByName(QAction *action, const QVariant &value)
     {
         const QString iconName = value.toString();
-        const QString previous = action->property(DBUSMENU_PROPERTY_ICON_NAME).toString();
-        if (previous == iconName) {
+        ActionInfo &info = m_actionInfo[action];
+        if (info.iconName == iconName) {
             return;
         }
-        action->setProperty(DBUSMENU_PROPERTY_ICON_NAME, iconName);
+        info.iconName = iconName;
         if (iconName.isEmpty()) {
             action->setIcon(QIcon());
             return;
@@ -223,24 +477,53 @@ public:
     void updateActionIconByData(QAction *action, const QVariant &value)
     {
         const QByteArray data = value.toByteArray();
-        uint dataHash = qHash(data);
-        uint previousDataHash = action->property(DBUSMENU_PROPERTY_ICON_DATA_HASH).toUInt();
-        if (previousDataHash == dataHash) {
+        const QByteArray digest = data.isEmpty() ? QByteArray() : DBusMenuIconDecoder::digest(data);
+        ActionInfo &info = m_actionInfo[action];
+        if (info.iconDataDigest == digest) {
+            return;
+        }
+        info.iconDataDigest = digest;
+        if (data.isEmpty()) {
+            action->setIcon(QIcon());
             return;
         }
-        action->setProperty(DBUSMENU_PROPERTY_ICON_DATA_HASH, dataHash);
-        QPixmap pix;
-        if (!pix.loadFromData(data)) {
+
+        QImage image;
+        if (m_iconDecoder->find(digest, &image)) {
+            applyIconData(action, image);
+            return;
+        }
+        m_pendingIconData[digest] << action;
+        m_iconDecoder->decode(digest, data);
+    }
+
+    void applyIconData(QAction *action, const QImage &image)
+    {
+        if (image.isNull()) {
             qDebug(DBUSMENUQT) << "Failed to decode icon-data property for action" << action->text();
             action->setIcon(QIcon());
             return;
         }
-        action->setIcon(QIcon(pix));
+        action->setIcon(QIcon(QPixmap::fromImage(image)));
+    }
+
+    void slotIconDataDecoded(const QByteArray &digest, const QImage &image)
+    {
+        const QVector<QPointer<QAction>> actions = m_pendingIconData.take(digest);
+        for (QAction *action : actions) {
+            // Skip actions that are gone or got other data meanwhile
+            if (action && m_actionInfo.value(action).iconDataDigest == digest) {
+                applyIconData(action, image);
+            }
+        }
     }
 
     void updateActionVisible(QAction *action, const QVariant &value)
     {
-        action->setVisible(value.isValid() ? value.toBool() : true);
+        const bool visible = value.isValid() ? value.toBool() : true;
+        if (action->isVisible() != visible) {
+            action->setVisible(visible);
+        }
     }
 
     void updateActionShortcut(QAction *action, const QVariant &value)
@@ -249,7 +532,9 @@ public:
         DBusMenuShortcut dmShortcut;
         arg >> dmShortcut;
         QKeySequence keySequence = dmShortcut.toKeySequence();
-        action->setShortcut(keySequence);
+        if (action->shortcut() != keySequence) {
+            action->setShortcut(keySequence);
+        }
     }
 
     QMenu *menuForId(int id) const
@@ -265,6 +550,26 @@ public:
     }
 
     void slotItemsPropertiesUpdated(const DBusMenuItemList &updatedList, const DBusMenuItemKeysList &removedList);
+    void queuePropertyUpdate(int id, const DBusMenuPropertyValue &property);
+    void queueDeferredOverride(int id, const DBusMenuPropertyValue &property);
+    static void replaceProperty(DBusMenuProperties &properties, const DBusMenuPropertyValue &property);
+    void flushPropertyUpdates();
+
+    void markMenuHidden(QMenu *menu)
+    {
+        // The menu bar and its top-level menus are kept, they are what
+        // AppMenuModel prefetched.
+        if (menu == m_menu || m_menu->actions().contains(menu->menuAction())) {
+            return;
+        }
+        if (!m_hiddenClock.isValid()) {
+            m_hiddenClock.start();
+        }
+        m_hiddenMenus.insert(menu, m_hiddenClock.elapsed());
+        if (!m_menuReleaseTimer->isActive()) {
+            m_menuReleaseTimer->start();
+        }
+    }
 
     void sendEvent(int id, const QString &eventId)
     {
@@ -273,6 +578,11 @@ public:
 };
 
 DBusMenuImporter::DBusMenuImporter(const QString &service, const QString &path, QObject *parent)
+    : DBusMenuImporter(service, path, ImportOneLevel, parent)
+{
+}
+
+DBusMenuImporter::DBusMenuImporter(const QString &service, const QString &path, ImportMode mode, QObject *parent)
     : QObject(parent)
     , d(new DBusMenuImporterPrivate)
 {
@@ -281,11 +591,31 @@ DBusMenuImporter::DBusMenuImporter(const QString &service, const QString &path,
     d->q = this;
     d->m_interface = new DBusMenuInterface(service, path, QDBusConnection::sessionBus(), this);
     d->m_menu = nullptr;
+    d->m_importMode = mode;
+
+    d->m_iconDecoder = DBusMenuIconDecoder::acquire();
+    connect(d->m_iconDecoder, &DBusMenuIconDecoder::decoded, this, [this](const QByteArray &digest, const QImage &image) {
+        d->slotIconDataDecoded(digest, image);
+    });
 
     d->m_pendingLayoutUpdateTimer = new QTimer(this);
     d->m_pendingLayoutUpdateTimer->setSingleShot(true);
     connect(d->m_pendingLayoutUpdateTimer, &QTimer::timeout, this, &DBusMenuImporter::processPendingLayoutUpdates);
 
+    d->m_propertyUpdateTimer = new QTimer(this);
+    d->m_propertyUpdateTimer->setSingleShot(true);
+    d->m_propertyUpdateTimer->setInterval(s_propertyUpdateInterval);
+    connect(d->m_propertyUpdateTimer, &QTimer::timeout, this, [this]() {
+        d->flushPropertyUpdates();
+    });
+
+    d->m_menuReleaseTimer = new QTimer(this);
+    d->m_menuReleaseTimer->setSingleShot(true);
+    d->m_menuReleaseTimer->setInterval(s_menuReleaseDelay);
+    connect(d->m_menuReleaseTimer, &QTimer::timeout, this, [this]() {
+        d->releaseUnusedMenus();
+    });
+
     connect(d->m_interface, &DBusMenuInterface::LayoutUpdated, this, &DBusMenuImporter::slotLayoutUpdated);
     connect(d->m_interface, &DBusMenuInterface::ItemActivationRequested, this, &DBusMenuImporter::slotItemActivationRequested);
     connect(d->m_interface,
@@ -304,26 +634,49 @@ DBusMenuImporter::~DBusMenuImporter()
     // leave enough time for the menu to finish what it was doing, for example
     // if it was being displayed.
     d->m_menu->deleteLater();
+    DBusMenuIconDecoder::release();
     delete d;
 }
 
 void DBusMenuImporter::slotLayoutUpdated(uint revision, int parentId)
 {
-    Q_UNUSED(revision)
+    d->noteRevision(revision);
     if (d->m_idsRefreshedByAboutToShow.remove(parentId)) {
         return;
     }
-    d->m_pendingLayoutUpdates << parentId;
-    if (!d->m_pendingLayoutUpdateTimer->isActive()) {
-        d->m_pendingLayoutUpdateTimer->start();
+    if (d->hasRevision(parentId, revision)) {
+        d->m_skippedRefreshes++;
+        qCDebug(DBUSMENUQT) << "Layout of" << parentId << "already at revision" << revision
+                            << "skipped refreshes:" << d->m_skippedRefreshes;
+        return;
     }
+    if (QMenu *menu = d->menuForId(parentId)) {
+        emit menuLayoutChanged(menu);
+    }
+    if (d->m_deferredMenus.contains(parentId)) {
+        // Not shown yet, it will be fetched again when it is
+        d->discardDeferredMenu(parentId);
+        return;
+    }
+    if (d->m_deferredItems.contains(parentId)) {
+        // Only this submenu is outdated, not the rest of the deferred menu
+        d->m_staleDeferredMenus.insert(parentId);
+        return;
+    }
+    d->m_pendingLayoutUpdates << parentId;
+    d->scheduleLayoutUpdates();
 }
 
 void DBusMenuImporter::processPendingLayoutUpdates()
 {
     QSet<int> ids = d->m_pendingLayoutUpdates;
     d->m_pendingLayoutUpdates.clear();
+    d->m_lastLayoutUpdate.start();
     Q_FOREACH (int id, ids) {
+        // A full tree refresh of a menu brings its submenus along
+        if (d->m_importMode == ImportFullTree && d->hasAncestorIn(id, ids)) {
+            continue;
+        }
         d->refresh(id);
     }
 }
@@ -338,29 +691,67 @@ QMenu *DBusMenuImporter::menu() const
 
 void DBusMenuImporterPrivate::slotItemsPropertiesUpdated(const DBusMenuItemList &updatedList, const DBusMenuItemKeysList &removedList)
 {
+    // Some applications send these on every cursor move. Only the last value
+    // of each property is kept, and they are applied together once per frame.
     Q_FOREACH (const DBusMenuItem &item, updatedList) {
-        QAction *action = m_actionForId.value(item.id);
-        if (!action) {
-            // We don't know this action. It probably is in a menu we haven't fetched yet.
-            continue;
+        for (const DBusMenuPropertyValue &property : item.properties) {
+            queuePropertyUpdate(item.id, property);
         }
+    }
 
-        QVariantMap::ConstIterator it = item.properties.constBegin(), end = item.properties.constEnd();
-        for (; it != end; ++it) {
-            updateActionProperty(action, it.key(), it.value());
+    Q_FOREACH (const DBusMenuItemKeys &item, removedList) {
+        Q_FOREACH (const QString &key, item.properties) {
+            queuePropertyUpdate(item.id, DBusMenuPropertyValue{DBusMenuProperty_fromName(key), key, QVariant()});
         }
     }
 
-    Q_FOREACH (const DBusMenuItemKeys &item, removedList) {
-        QAction *action = m_actionForId.value(item.id);
+    if (!m_pendingPropertyUpdates.isEmpty() && !m_propertyUpdateTimer->isActive()) {
+        m_propertyUpdateTimer->start();
+    }
+}
+
+void DBusMenuImporterPrivate::queuePropertyUpdate(int id, const DBusMenuPropertyValue &property)
+{
+    replaceProperty(m_pendingPropertyUpdates[id], property);
+}
+
+void DBusMenuImporterPrivate::queueDeferredOverride(int id, const DBusMenuPropertyValue &property)
+{
+    replaceProperty(m_deferredOverrides[id], property);
+}
+
+void DBusMenuImporterPrivate::replaceProperty(DBusMenuProperties &properties, const DBusMenuPropertyValue &property)
+{
+    for (DBusMenuPropertyValue &pending : properties) {
+        if (pending.name == property.name) {
+            pending = property;
+            return;
+        }
+    }
+    properties.append(property);
+}
+
+void DBusMenuImporterPrivate::flushPropertyUpdates()
+{
+    m_propertyUpdateTimer->stop();
+
+    QHash<int, DBusMenuProperties> updates;
+    updates.swap(m_pendingPropertyUpdates);
+
+    for (auto it = updates.constBegin(); it != updates.constEnd(); ++it) {
+        QAction *action = m_actionForId.value(it.key());
         if (!action) {
-            // We don't know this action. It probably is in a menu we haven't fetched yet.
+            // We don't know this action. It probably is in a menu we haven't fetched
+            // yet, or one we have not shown yet, which gets the update when it is.
+            if (m_deferredItems.contains(it.key())) {
+                for (const DBusMenuPropertyValue &property : it.value()) {
+                    queueDeferredOverride(it.key(), property);
+                }
+            }
             continue;
         }
 
-        Q_FOREACH (const QString &key, item.properties) {
-            updateActionProperty(action, key, QVariant());
-        }
+        updateAction(action, it.value());
     }
 }
 
@@ -369,6 +760,11 @@ QAction *DBusMenuImporter::actionForId(int id) const
     return d->m_actionForId.value(id);
 }
 
+DBusMenuImporter::ImportMode DBusMenuImporter::importMode() const
+{
+    return d->m_importMode;
+}
+
 void DBusMenuImporter::slotItemActivationRequested(int id, uint /*timestamp*/)
 {
     QAction *action = d->m_actionForId.value(id);
@@ -378,12 +774,21 @@ void DBusMenuImporter::slotItemActivationRequested(int id, uint /*timestamp*/)
 
 void DBusMenuImporter::slotGetLayoutFinished(QDBusPendingCallWatcher *watcher)
 {
-    int parentId = watcher->property(DBUSMENU_PROPERTY_ID).toInt();
+    int parentId = d->m_watcherIds.take(watcher);
     watcher->deleteLater();
 
+    if (d->m_layoutCalls.value(parentId) != watcher) {
+        // A newer call for the same menu is in flight, its reply will do.
+        d->m_droppedReplies++;
+        qCDebug(DBUSMENUQT) << "Dropped superseded layout of" << parentId
+                            << "dropped replies:" << d->m_droppedReplies;
+        return;
+    }
+    d->m_layoutCalls.remove(parentId);
+
     QMenu *menu = d->menuForId(parentId);
 
-    QDBusPendingReply<uint, DBusMenuLayoutItem> reply = *watcher;
+    QDBusPendingReply<uint, DBusMenuLayout> reply = *watcher;
     if (!reply.isValid()) {
         qDebug(DBUSMENUQT) << reply.error().message();
         if (menu) {
@@ -392,24 +797,71 @@ void DBusMenuImporter::slotGetLayoutFinished(QDBusPendingCallWatcher *watcher)
         return;
     }
 
-#ifdef BENCHMARK
-    DMDEBUG << "- items received:" << sChrono.elapsed() << "ms";
-#endif
-    DBusMenuLayoutItem rootItem = reply.argumentAt<1>();
-
     if (!menu) {
         qDebug(DBUSMENUQT) << "No menu for id" << parentId;
         return;
     }
 
+    const uint revision = reply.argumentAt<0>();
+    d->noteRevision(revision);
+    d->m_layoutRevisions.insert(parentId, revision);
+
+    const QSharedPointer<const DBusMenuLayout> layout(new DBusMenuLayout(reply.argumentAt<1>()));
+
+#ifdef BENCHMARK
+    const qint64 received = sChrono.elapsed();
+#endif
+
+    // Apply the updates that arrived before the reply first
+    d->flushPropertyUpdates();
+
+    // Anything deferred for this menu is superseded by the reply
+    d->discardDeferredMenu(parentId);
+    d->forgetDeferredItems(*layout);
+    const int itemCount = layout->nodes.isEmpty() ? 0 : d->applyLayout(menu, layout, 0);
+
+#ifdef BENCHMARK
+    const qint64 start = watcher->property(DBUSMENU_PROPERTY_BENCHMARK_START).toLongLong();
+    qCDebug(DBUSMENUQT) << "GetLayout" << parentId
+        << "depth:" << (d->m_importMode == ImportFullTree ? -1 : 1)
+        << "items:" << itemCount
+        << "round trip:" << received - start << "ms"
+        << "materialized:" << sChrono.elapsed() - received << "ms";
+#else
+    Q_UNUSED(itemCount)
+#endif
+
+    emit menuUpdated(menu);
+}
+
+int DBusMenuImporterPrivate::applyLayout(QMenu *menu, const QSharedPointer<const DBusMenuLayout> &layoutPointer, int parentNode)
+{
+    const DBusMenuLayout &layout = *layoutPointer;
+    QVector<int> childNodes;
+    for (int node = layout.firstChild(parentNode); node >= 0; node = layout.nextSibling(node)) {
+        childNodes << node;
+    }
+    int itemCount = childNodes.count();
+
+    QStringList iconNames;
+    for (int node : qAsConst(childNodes)) {
+        const QString iconName = DBusMenuProperties_value(layout.propertiesOf(node), DBusMenuProperty::IconName).toString();
+        if (!iconName.isEmpty()) {
+            iconNames << iconName;
+        }
+    }
+    if (!iconNames.isEmpty()) {
+        q->prepareIcons(iconNames);
+    }
+
     // remove outdated actions
     QSet<int> newDBusMenuItemIds;
-    newDBusMenuItemIds.reserve(rootItem.children.count());
-    for (const DBusMenuLayoutItem &item : qAsConst(rootItem.children)) {
-        newDBusMenuItemIds << item.id;
+    newDBusMenuItemIds.reserve(childNodes.count());
+    for (int node : qAsConst(childNodes)) {
+        newDBusMenuItemIds << layout.nodes.at(node).id;
     }
     for (QAction *action : menu->actions()) {
-        int id = action->property(DBUSMENU_PROPERTY_ID).toInt();
+        int id = idForAction(action);
         if (!newDBusMenuItemIds.contains(id)) {
             // Not calling removeAction() as QMenu will immediately close when it becomes empty,
             // which can happen when an application completely reloads this menu.
@@ -418,47 +870,168 @@ void DBusMenuImporter::slotGetLayoutFinished(QDBusPendingCallWatcher *watcher)
             if (action->menu()) {
                 action->menu()->deleteLater();
             }
-            d->m_actionForId.remove(id);
+            m_actionForId.remove(id);
+            discardDeferredMenu(id);
         }
     }
 
     // insert or update new actions into our menu
-    for (const DBusMenuLayoutItem &dbusMenuItem : qAsConst(rootItem.children)) {
-        DBusMenuImporterPrivate::ActionForId::Iterator it = d->m_actionForId.find(dbusMenuItem.id);
+    QVector<QAction *> orderedActions;
+    orderedActions.reserve(childNodes.count());
+    for (int node : qAsConst(childNodes)) {
+        const int id = layout.nodes.at(node).id;
+        DBusMenuImporterPrivate::ActionForId::Iterator it = m_actionForId.find(id);
         QAction *action = nullptr;
-        if (it == d->m_actionForId.end()) {
-            int id = dbusMenuItem.id;
-            action = d->createAction(id, dbusMenuItem.properties, menu);
-            d->m_actionForId.insert(id, action);
-
-            connect(action, &QObject::destroyed, this, [this, id]() {
-                d->m_actionForId.remove(id);
+        if (it == m_actionForId.end()) {
+            action = createAction(id, layout.propertiesOf(node), menu);
+            m_actionForId.insert(id, action);
+
+            QObject::connect(action, &QObject::destroyed, q, [this, id, action]() {
+                // The id may already belong to a newer action
+                if (m_actionForId.value(id) == action) {
+                    m_actionForId.remove(id);
+                    m_layoutRevisions.remove(id);
+                    discardDeferredMenu(id);
+                }
+                m_actionInfo.remove(action);
             });
 
-            connect(action, &QAction::triggered, this, [id, this]() {
-                sendClickedEvent(id);
+            QObject::connect(action, &QAction::triggered, q, [id, this]() {
+                q->sendClickedEvent(id);
             });
 
             if (QMenu *menuAction = action->menu()) {
-                connect(menuAction, &QMenu::aboutToShow, this, &DBusMenuImporter::slotMenuAboutToShow, Qt::UniqueConnection);
+                QObject::connect(menuAction, &QMenu::aboutToShow, q, &DBusMenuImporter::slotMenuAboutToShow, Qt::UniqueConnection);
+                QObject::connect(menuAction, &QObject::destroyed, q, [this, menuAction]() {
+                    m_hiddenMenus.remove(menuAction);
+                });
             }
-            connect(menu, &QMenu::aboutToHide, this, &DBusMenuImporter::slotMenuAboutToHide, Qt::UniqueConnection);
-
-            menu->addAction(action);
+            QObject::connect(menu, &QMenu::aboutToHide, q, &DBusMenuImporter::slotMenuAboutToHide, Qt::UniqueConnection);
         } else {
             action = *it;
-            QStringList filteredKeys = dbusMenuItem.properties.keys();
-            filteredKeys.removeOne("type");
-            filteredKeys.removeOne("toggle-type");
-            filteredKeys.removeOne("children-display");
-            d->updateAction(*it, dbusMenuItem.properties, filteredKeys);
-            // Move the action to the tail so we can keep the order same as the dbus request.
+            updateAction(action, layout.propertiesOf(node));
+        }
+        const DBusMenuProperties overrides = m_deferredOverrides.take(id);
+        if (!overrides.isEmpty()) {
+            updateAction(action, overrides);
+        }
+        orderedActions << action;
+
+        // With ImportFullTree the children of submenus are in the same reply.
+        // Submenus that already have actions are updated right away, the
+        // others only when they are about to be shown. A submenu without
+        // children may just not be populated yet, so leave it as is until it
+        // is refreshed on its own.
+        if (action->menu() && layout.hasChildren(node)) {
+            if (action->menu()->actions().isEmpty()) {
+                if (!m_staleDeferredMenus.remove(id)) {
+                    deferMenu(id, layoutPointer, node);
+                }
+                itemCount += layout.nodes.at(node).subtreeEnd - node - 1;
+            } else {
+                itemCount += applyLayout(action->menu(), layoutPointer, node);
+            }
+        }
+    }
+
+    reorderActions(menu, orderedActions);
+
+    return itemCount;
+}
+
+void DBusMenuImporterPrivate::releaseUnusedMenus()
+{
+    const qint64 now = m_hiddenClock.elapsed();
+    for (auto it = m_hiddenMenus.begin(); it != m_hiddenMenus.end();) {
+        QMenu *menu = it.key();
+        if (menu->isVisible()) {
+            it = m_hiddenMenus.erase(it);
+            continue;
+        }
+        if (now - it.value() < s_menuReleaseDelay) {
+            ++it;
+            continue;
+        }
+        it = m_hiddenMenus.erase(it);
+
+        // The menu is empty now, so it is fetched again when next shown.
+        for (QAction *action : menu->actions()) {
+            const int id = idForAction(action);
+            if (m_actionForId.value(id) == action) {
+                m_actionForId.remove(id);
+                discardDeferredMenu(id);
+            }
             menu->removeAction(action);
-            menu->addAction(action);
+            if (action->menu()) {
+                action->menu()->deleteLater();
+            }
+            action->deleteLater();
         }
     }
 
-    emit menuUpdated(menu);
+    if (!m_hiddenMenus.isEmpty()) {
+        m_menuReleaseTimer->start();
+    }
+}
+
+void DBusMenuImporterPrivate::reorderActions(QMenu *menu, const QVector<QAction *> &orderedActions)
+{
+    // Every insertAction() makes the QMenu relayout, so rather than moving
+    // every action to the tail, keep the longest run of actions that are
+    // already in the right relative order and only move the others.
+
+    QHash<QAction *, int> targetIndex;
+    targetIndex.reserve(orderedActions.count());
+    for (int i = 0; i < orderedActions.count(); ++i) {
+        targetIndex.insert(orderedActions.at(i), i);
+    }
+
+    // Target indexes of the actions already in the menu, in menu order.
+    // Outdated actions are still in the menu until their deferred delete.
+    QVector<int> sequence;
+    sequence.reserve(orderedActions.count());
+    for (QAction *action : menu->actions()) {
+        const int index = targetIndex.value(action, -1);
+        if (index >= 0) {
+            sequence << index;
+        }
+    }
+
+    // Nothing new and nothing out of place.
+    if (sequence.count() == orderedActions.count() && std::is_sorted(sequence.cbegin(), sequence.cend())) {
+        return;
+    }
+
+    // Longest increasing subsequence, O(n log n).
+    QVector<int> tails; // position in sequence of the smallest tail of each length
+    QVector<int> previous(sequence.count(), -1);
+    for (int i = 0; i < sequence.count(); ++i) {
+        auto it = std::lower_bound(tails.begin(), tails.end(), sequence.at(i), [&sequence](int position, int value) {
+            return sequence.at(position) < value;
+        });
+        if (it != tails.begin()) {
+            previous[i] = *(it - 1);
+        }
+        if (it == tails.end()) {
+            tails << i;
+        } else {
+            *it = i;
+        }
+    }
+    QVector<bool> inPlace(orderedActions.count(), false);
+    for (int i = tails.isEmpty() ? -1 : tails.last(); i >= 0; i = previous.at(i)) {
+        inPlace[sequence.at(i)] = true;
+    }
+
+    // Walk backwards so each action is placed in front of its successor.
+    QAction *before = nullptr;
+    for (int i = orderedActions.count() - 1; i >= 0; --i) {
+        QAction *action = orderedActions.at(i);
+        if (!inPlace.at(i)) {
+            menu->insertAction(before, action);
+        }
+        before = action;
+    }
 }
 
 void DBusMenuImporter::sendClickedEvent(int id)
@@ -478,11 +1051,15 @@ void DBusMenuImporter::updateMenu(QMenu *menu)
     QAction *action = menu->menuAction();
     Q_ASSERT(action);
 
-    int id = action->property(DBUSMENU_PROPERTY_ID).toInt();
+    int id = d->idForAction(action);
+
+    d->m_hiddenMenus.remove(menu);
+    d->flushPropertyUpdates();
+    d->materializeMenu(menu, id);
 
     auto call = d->m_interface->AboutToShow(id);
     QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
-    watcher->setProperty(DBUSMENU_PROPERTY_ID, id);
+    d->m_watcherIds.insert(watcher, id);
     connect(watcher, &QDBusPendingCallWatcher::finished, this, &DBusMenuImporter::slotAboutToShowDBusCallFinished);
 
     // Firefox deliberately ignores "aboutToShow" whereas Qt ignores" opened", so we'll just send both all the time...
@@ -491,7 +1068,7 @@ void DBusMenuImporter::updateMenu(QMenu *menu)
 
 void DBusMenuImporter::slotAboutToShowDBusCallFinished(QDBusPendingCallWatcher *watcher)
 {
-    int id = watcher->property(DBUSMENU_PROPERTY_ID).toInt();
+    int id = d->m_watcherIds.take(watcher);
     watcher->deleteLater();
 
     QMenu *menu = d->menuForId(id);
@@ -525,8 +1102,10 @@ void DBusMenuImporter::slotMenuAboutToHide()
     QAction *action = menu->menuAction();
     Q_ASSERT(action);
 
-    int id = action->property(DBUSMENU_PROPERTY_ID).toInt();
+    int id = d->idForAction(action);
     d->sendEvent(id, QStringLiteral("closed"));
+
+    d->markMenuHidden(menu);
 }
 
 void DBusMenuImporter::slotMenuAboutToShow()
@@ -547,4 +1126,8 @@ QIcon DBusMenuImporter::iconForName(const QString & /*name*/)
     return QIcon();
 }
 
+void DBusMenuImporter::prepareIcons(const QStringList & /*names*/)
+{
+}
+
 #include "moc_dbusmenuimporter.cpp"
@@ -23,6 +23,7 @@
 
 // Qt
 #include <QObject>
+#include <QStringList>
 
 class QAction;
 class QDBusPendingCallWatcher;
@@ -39,15 +40,36 @@ class DBusMenuImporter : public QObject
 {
     Q_OBJECT
 public:
+    /**
+     * How much of the menu tree a single GetLayout() call asks for
+     */
+    enum ImportMode {
+        /**
+         * Only the direct children of the refreshed menu (recursionDepth = 1).
+         * Submenus are fetched when they are about to be shown. Use this for
+         * applications that only build their submenus on AboutToShow.
+         */
+        ImportOneLevel,
+        /**
+         * The whole subtree of the refreshed menu (recursionDepth = -1), so
+         * a menu of depth N is imported in one round trip instead of N.
+         */
+        ImportFullTree,
+    };
+
     /**
      * Creates a DBusMenuImporter listening over DBus on service, path
      */
     DBusMenuImporter(const QString &service, const QString &path, QObject *parent = nullptr);
 
+    DBusMenuImporter(const QString &service, const QString &path, ImportMode mode, QObject *parent = nullptr);
+
     ~DBusMenuImporter() override;
 
     QAction *actionForId(int id) const;
 
+    ImportMode importMode() const;
+
     /**
      * The menu created from listening to the DBusMenuExporter over DBus
      */
@@ -71,6 +93,12 @@ Q_SIGNALS:
      */
     void menuUpdated(QMenu *);
 
+    /**
+     * Emitted when the application reports that the layout of @p menu
+     * changed, and it is not already being fetched.
+     */
+    void menuLayoutChanged(QMenu *menu);
+
     /**
      * Emitted when the exporter was asked to activate an action
      */
@@ -89,6 +117,13 @@ protected:
      */
     virtual QIcon iconForName(const QString &);
 
+    /**
+     * Called with the icon names of a menu's items before they are created or
+     * updated, so the icons can be resolved in one go.
+     * Default implementation does nothing.
+     */
+    virtual void prepareIcons(const QStringList &names);
+
 private Q_SLOTS:
     void sendClickedEvent(int);
     void slotMenuAboutToShow();
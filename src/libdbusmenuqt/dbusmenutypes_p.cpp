@@ -26,6 +26,70 @@
 // Qt
 #include <QDBusArgument>
 #include <QDBusMetaType>
+#include <QHash>
+
+//// DBusMenuProperty
+DBusMenuProperty DBusMenuProperty_fromName(const QString &name)
+{
+    static const QHash<QString, DBusMenuProperty> s_properties = {
+        {QStringLiteral("type"), DBusMenuProperty::Type},
+        {QStringLiteral("label"), DBusMenuProperty::Label},
+        {QStringLiteral("enabled"), DBusMenuProperty::Enabled},
+        {QStringLiteral("visible"), DBusMenuProperty::Visible},
+        {QStringLiteral("icon-name"), DBusMenuProperty::IconName},
+        {QStringLiteral("icon-data"), DBusMenuProperty::IconData},
+        {QStringLiteral("toggle-type"), DBusMenuProperty::ToggleType},
+        {QStringLiteral("toggle-state"), DBusMenuProperty::ToggleState},
+        {QStringLiteral("children-display"), DBusMenuProperty::ChildrenDisplay},
+        {QStringLiteral("shortcut"), DBusMenuProperty::Shortcut},
+        {QStringLiteral("x-kde-title"), DBusMenuProperty::KdeTitle},
+    };
+    return s_properties.value(name, DBusMenuProperty::Unknown);
+}
+
+QDBusArgument &operator<<(QDBusArgument &argument, const DBusMenuProperties &properties)
+{
+    argument.beginMap(qMetaTypeId<QString>(), qMetaTypeId<QDBusVariant>());
+    for (const DBusMenuPropertyValue &property : properties) {
+        argument.beginMapEntry();
+        argument << property.name << QDBusVariant(property.value);
+        argument.endMapEntry();
+    }
+    argument.endMap();
+    return argument;
+}
+
+// Appends the a{sv} map at the current position to properties
+static void readProperties(const QDBusArgument &argument, QVector<DBusMenuPropertyValue> &properties)
+{
+    argument.beginMap();
+    while (!argument.atEnd()) {
+        DBusMenuPropertyValue property;
+        argument.beginMapEntry();
+        argument >> property.name >> property.value;
+        argument.endMapEntry();
+        property.key = DBusMenuProperty_fromName(property.name);
+        properties.append(property);
+    }
+    argument.endMap();
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &argument, DBusMenuProperties &properties)
+{
+    properties.clear();
+    readProperties(argument, properties);
+    return argument;
+}
+
+QVariant DBusMenuProperties_value(DBusMenuPropertySpan properties, DBusMenuProperty key)
+{
+    for (const DBusMenuPropertyValue &property : properties) {
+        if (property.key == key) {
+            return property.value;
+        }
+    }
+    return QVariant();
+}
 
 //// DBusMenuItem
 QDBusArgument &operator<<(QDBusArgument &argument, const DBusMenuItem &obj)
@@ -94,6 +158,73 @@ const QDBusArgument &operator>>(const QDBusArgument &argument, DBusMenuLayoutIte
     return argument;
 }
 
+//// DBusMenuLayout
+static DBusMenuLayoutItem layoutItem(const DBusMenuLayout &layout, int node)
+{
+    DBusMenuLayoutItem item;
+    item.id = layout.nodes.at(node).id;
+    for (const DBusMenuPropertyValue &property : layout.propertiesOf(node)) {
+        item.properties.append(property);
+    }
+    for (int child = layout.firstChild(node); child >= 0; child = layout.nextSibling(child)) {
+        item.children.append(layoutItem(layout, child));
+    }
+    return item;
+}
+
+QDBusArgument &operator<<(QDBusArgument &argument, const DBusMenuLayout &obj)
+{
+    // Only the importer side is performance sensitive
+    if (obj.nodes.isEmpty()) {
+        argument << DBusMenuLayoutItem{0, {}, {}};
+    } else {
+        argument << layoutItem(obj, 0);
+    }
+    return argument;
+}
+
+// Sizes of the last layout read, to reserve the arrays of the next one
+static int s_lastNodeCount = 0;
+static int s_lastPropertyCount = 0;
+
+static void readLayoutNode(const QDBusArgument &argument, DBusMenuLayout &layout, int parent)
+{
+    const int node = layout.nodes.count();
+    layout.nodes.append(DBusMenuLayoutNode{0, parent, 0, layout.properties.count(), 0});
+
+    argument.beginStructure();
+    argument >> layout.nodes[node].id;
+    readProperties(argument, layout.properties);
+    layout.nodes[node].propertyCount = layout.properties.count() - layout.nodes.at(node).firstProperty;
+
+    // Children are variants; unwrapping one only yields a cursor into the
+    // same message, which is read in place.
+    argument.beginArray();
+    while (!argument.atEnd()) {
+        QDBusVariant dbusVariant;
+        argument >> dbusVariant;
+        readLayoutNode(dbusVariant.variant().value<QDBusArgument>(), layout, node);
+    }
+    argument.endArray();
+    argument.endStructure();
+
+    layout.nodes[node].subtreeEnd = layout.nodes.count();
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &argument, DBusMenuLayout &obj)
+{
+    obj.nodes.clear();
+    obj.properties.clear();
+    obj.nodes.reserve(s_lastNodeCount);
+    obj.properties.reserve(s_lastPropertyCount);
+
+    readLayoutNode(argument, obj, -1);
+
+    s_lastNodeCount = obj.nodes.count();
+    s_lastPropertyCount = obj.properties.count();
+    return argument;
+}
+
 //// DBusMenuShortcut
 QDBusArgument &operator<<(QDBusArgument &argument, const DBusMenuShortcut &obj)
 {
@@ -131,6 +262,7 @@ void DBusMenuTypes_register()
     qDBusRegisterMetaType<DBusMenuItemKeysList>();
     qDBusRegisterMetaType<DBusMenuLayoutItem>();
     qDBusRegisterMetaType<DBusMenuLayoutItemList>();
+    qDBusRegisterMetaType<DBusMenuLayout>();
     qDBusRegisterMetaType<DBusMenuShortcut>();
     registered = true;
 }
@@ -25,16 +25,92 @@
 #include <QList>
 #include <QStringList>
 #include <QVariant>
+#include <QVector>
 
 class QDBusArgument;
 
+//// DBusMenuProperty
+/**
+ * Item properties known to the importer. Property names are interned to this
+ * when an item is demarshalled, so they can be dispatched with a switch
+ * instead of comparing strings.
+ */
+enum class DBusMenuProperty : quint8 {
+    Unknown,
+    Type,
+    Label,
+    Enabled,
+    Visible,
+    IconName,
+    IconData,
+    ToggleType,
+    ToggleState,
+    ChildrenDisplay,
+    Shortcut,
+    KdeTitle,
+};
+
+DBusMenuProperty DBusMenuProperty_fromName(const QString &name);
+
+/**
+ * A single property of an item, as sent in an a{sv} map
+ */
+struct DBusMenuPropertyValue {
+    DBusMenuProperty key;
+    QString name;
+    QVariant value;
+};
+
+Q_DECLARE_TYPEINFO(DBusMenuPropertyValue, Q_MOVABLE_TYPE);
+
+typedef QVector<DBusMenuPropertyValue> DBusMenuProperties;
+
+QDBusArgument &operator<<(QDBusArgument &argument, const DBusMenuProperties &properties);
+const QDBusArgument &operator>>(const QDBusArgument &argument, DBusMenuProperties &properties);
+
+/**
+ * A view on consecutive properties, either a DBusMenuProperties or the
+ * properties of a DBusMenuLayout node
+ */
+struct DBusMenuPropertySpan {
+    DBusMenuPropertySpan(const DBusMenuPropertyValue *first, int count)
+        : m_first(first)
+        , m_last(first + count)
+    {
+    }
+
+    DBusMenuPropertySpan(const DBusMenuProperties &properties)
+        : DBusMenuPropertySpan(properties.constData(), properties.count())
+    {
+    }
+
+    const DBusMenuPropertyValue *begin() const
+    {
+        return m_first;
+    }
+
+    const DBusMenuPropertyValue *end() const
+    {
+        return m_last;
+    }
+
+private:
+    const DBusMenuPropertyValue *m_first;
+    const DBusMenuPropertyValue *m_last;
+};
+
+/**
+ * Returns the value of @p key, or an invalid QVariant if it was not sent
+ */
+QVariant DBusMenuProperties_value(DBusMenuPropertySpan properties, DBusMenuProperty key);
+
 //// DBusMenuItem
 /**
  * Internal struct used to communicate on DBus
  */
 struct DBusMenuItem {
     int id;
-    QVariantMap properties;
+    DBusMenuProperties properties;
 };
 
 Q_DECLARE_METATYPE(DBusMenuItem)
@@ -66,13 +142,13 @@ Q_DECLARE_METATYPE(DBusMenuItemKeysList)
 
 //// DBusMenuLayoutItem
 /**
- * Represents an item with its children. GetLayout() returns a
- * DBusMenuLayoutItemList.
+ * Represents an item with its children. The importer reads GetLayout()
+ * replies as a DBusMenuLayout instead, which does not copy every level.
  */
 struct DBusMenuLayoutItem;
 struct DBusMenuLayoutItem {
     int id;
-    QVariantMap properties;
+    DBusMenuProperties properties;
     QList<DBusMenuLayoutItem> children;
 };
 
@@ -85,6 +161,57 @@ typedef QList<DBusMenuLayoutItem> DBusMenuLayoutItemList;
 
 Q_DECLARE_METATYPE(DBusMenuLayoutItemList)
 
+//// DBusMenuLayout
+/**
+ * A GetLayout() reply read straight into flat arrays.
+ *
+ * Nodes are stored depth-first starting with the root at index 0, so the
+ * first child of a node directly follows it and each subtree ends at
+ * subtreeEnd. The properties of all nodes share a single array.
+ */
+struct DBusMenuLayoutNode {
+    int id;
+    int parent; // -1 for the root
+    int subtreeEnd; // one past the last descendant
+    int firstProperty;
+    int propertyCount;
+};
+
+Q_DECLARE_TYPEINFO(DBusMenuLayoutNode, Q_PRIMITIVE_TYPE);
+
+struct DBusMenuLayout {
+    QVector<DBusMenuLayoutNode> nodes;
+    QVector<DBusMenuPropertyValue> properties;
+
+    bool hasChildren(int node) const
+    {
+        return nodes.at(node).subtreeEnd > node + 1;
+    }
+
+    int firstChild(int node) const
+    {
+        return hasChildren(node) ? node + 1 : -1;
+    }
+
+    int nextSibling(int node) const
+    {
+        const int next = nodes.at(node).subtreeEnd;
+        const int parent = nodes.at(node).parent;
+        return parent >= 0 && next < nodes.at(parent).subtreeEnd ? next : -1;
+    }
+
+    DBusMenuPropertySpan propertiesOf(int node) const
+    {
+        const DBusMenuLayoutNode &n = nodes.at(node);
+        return DBusMenuPropertySpan(properties.constData() + n.firstProperty, n.propertyCount);
+    }
+};
+
+Q_DECLARE_METATYPE(DBusMenuLayout)
+
+QDBusArgument &operator<<(QDBusArgument &argument, const DBusMenuLayout &);
+const QDBusArgument &operator>>(const QDBusArgument &argument, DBusMenuLayout &);
+
 //// DBusMenuShortcut
 
 class DBusMenuShortcut;
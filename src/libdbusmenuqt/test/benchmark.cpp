@@ -0,0 +1,157 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+// Compares reading a GetLayout() reply as a DBusMenuLayoutItem tree and as a
+// flat DBusMenuLayout.
+//
+// The reply is produced by calling an object exported by this process, which
+// QtDBus marshals and demarshals like a remote reply, so a session bus is needed.
+//
+// dbusmenubench [itemCount...]
+
+#include "dbusmenutypes_p.h"
+
+#include <QCoreApplication>
+#include <QDBusArgument>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QtMath>
+
+class LayoutProvider : public QObject
+{
+    Q_OBJECT
+
+public Q_SLOTS:
+    DBusMenuLayoutItem GetLayout(int itemCount);
+
+private:
+    DBusMenuLayoutItem createItem(int depth, int fanout, int &remaining);
+
+    int m_nextId = 0;
+};
+
+DBusMenuLayoutItem LayoutProvider::GetLayout(int itemCount)
+{
+    // Three levels, like a menu bar with submenus that have submenus
+    const int fanout = qCeil(std::cbrt(static_cast<double>(itemCount)));
+    m_nextId = 0;
+    return createItem(0, fanout, itemCount);
+}
+
+DBusMenuLayoutItem LayoutProvider::createItem(int depth, int fanout, int &remaining)
+{
+    DBusMenuLayoutItem item;
+    item.id = m_nextId++;
+    item.properties = {
+        {DBusMenuProperty::Label, QStringLiteral("label"), QStringLiteral("Item _%1").arg(item.id)},
+        {DBusMenuProperty::Enabled, QStringLiteral("enabled"), true},
+        {DBusMenuProperty::Visible, QStringLiteral("visible"), true},
+        {DBusMenuProperty::IconName, QStringLiteral("icon-name"), QStringLiteral("document-open")},
+    };
+
+    if (depth < 3) {
+        for (int i = 0; i < fanout && remaining > 0; ++i) {
+            --remaining;
+            item.children.append(createItem(depth + 1, fanout, remaining));
+        }
+        if (!item.children.isEmpty()) {
+            item.properties.append({DBusMenuProperty::ChildrenDisplay, QStringLiteral("children-display"), QStringLiteral("submenu")});
+        }
+    }
+    return item;
+}
+
+static int countNodes(const DBusMenuLayoutItem &item)
+{
+    int count = 1;
+    for (const DBusMenuLayoutItem &child : item.children) {
+        count += countNodes(child);
+    }
+    return count;
+}
+
+static int countNodes(const DBusMenuLayout &layout)
+{
+    return layout.nodes.count();
+}
+
+template<typename T>
+static qint64 measure(const QDBusArgument &reply, int iterations, int *nodeCount)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < iterations; ++i) {
+        // Reading detaches the copy, so every iteration starts from the top
+        QDBusArgument argument = reply;
+        T layout;
+        argument >> layout;
+        if (i == 0) {
+            *nodeCount = countNodes(layout);
+        }
+    }
+    return timer.nsecsElapsed() / iterations;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    DBusMenuTypes_register();
+
+    QList<int> itemCounts;
+    for (int i = 1; i < argc; ++i) {
+        const int itemCount = atoi(argv[i]);
+        if (itemCount > 0) {
+            itemCounts << itemCount;
+        }
+    }
+    if (itemCounts.isEmpty()) {
+        itemCounts = {1000, 10000, 50000};
+    }
+
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    LayoutProvider provider;
+    if (!bus.registerObject(QStringLiteral("/MenuBar"), &provider, QDBusConnection::ExportAllSlots)) {
+        qWarning() << "Could not register on the session bus";
+        return 1;
+    }
+
+    for (int itemCount : qAsConst(itemCounts)) {
+        QDBusMessage call = QDBusMessage::createMethodCall(bus.baseService(), QStringLiteral("/MenuBar"), QString(), QStringLiteral("GetLayout"));
+        call << itemCount;
+        const QDBusMessage reply = bus.call(call);
+        if (reply.type() != QDBusMessage::ReplyMessage) {
+            qWarning() << "GetLayout failed:" << reply.errorMessage();
+            return 1;
+        }
+        const QDBusArgument argument = reply.arguments().at(0).value<QDBusArgument>();
+
+        const int iterations = qMax(1, 200000 / itemCount);
+        int treeNodes = 0;
+        int flatNodes = 0;
+        const qint64 tree = measure<DBusMenuLayoutItem>(argument, iterations, &treeNodes);
+        const qint64 flat = measure<DBusMenuLayout>(argument, iterations, &flatNodes);
+
+        qInfo().nospace() << "items: " << itemCount << " nodes: " << treeNodes << "/" << flatNodes
+                          << " tree: " << tree / 1000 << "us flat: " << flat / 1000 << "us";
+    }
+
+    return 0;
+}
+
+#include "benchmark.moc"
@@ -23,11 +23,16 @@
 #include <QIcon>
 #include <QMainWindow>
 #include <QMenuBar>
+#include <QScopedPointer>
 
 class MainWindow : public QMainWindow
 {
 public:
     MainWindow();
+    MainWindow(int menuCount, int depth, int itemCount);
+
+private:
+    void addSyntheticItems(QMenu *menu, int depth, int itemCount);
 };
 
 MainWindow::MainWindow()
@@ -75,10 +80,46 @@ MainWindow::MainWindow()
     menuBar()->addAction("Top Level Item");
 }
 
+/*
+ * Synthetic menu for comparing the importer's one level and full tree
+ * imports (build dbusmenuimporter.cpp with BENCHMARK defined):
+ *   menuCount top level menus, each nested depth levels deep with
+ *   itemCount items and one submenu per level.
+ */
+MainWindow::MainWindow(int menuCount, int depth, int itemCount)
+    : QMainWindow()
+{
+    for (int i = 0; i < menuCount; ++i) {
+        auto menu = new QMenu(QStringLiteral("Menu %1").arg(i), this);
+        addSyntheticItems(menu, depth, itemCount);
+        menuBar()->addMenu(menu);
+    }
+}
+
+void MainWindow::addSyntheticItems(QMenu *menu, int depth, int itemCount)
+{
+    for (int i = 0; i < itemCount; ++i) {
+        menu->addAction(QStringLiteral("Item %1").arg(i));
+    }
+
+    if (depth > 1) {
+        auto submenu = new QMenu(QStringLiteral("Submenu"), menu);
+        addSyntheticItems(submenu, depth - 1, itemCount);
+        menu->addMenu(submenu);
+    }
+}
+
 int main(int argc, char **argv)
 {
     QApplication app(argc, argv);
-    MainWindow mw;
-    mw.show();
+
+    // appmenutest [menuCount depth itemCount]
+    QScopedPointer<MainWindow> mw;
+    if (argc == 4) {
+        mw.reset(new MainWindow(atoi(argv[1]), atoi(argv[2]), atoi(argv[3])));
+    } else {
+        mw.reset(new MainWindow());
+    }
+    mw->show();
     return app.exec();
 }